@@ -0,0 +1,114 @@
+// Shared by every compute primitive. Buffers are passed as device addresses in push constants,
+// so kernels need no descriptor sets.
+#extension GL_EXT_buffer_reference : require
+#extension GL_EXT_shader_explicit_arithmetic_types_int64 : require
+#extension GL_EXT_shader_atomic_int64 : require
+#extension GL_KHR_shader_subgroup_basic : require
+#extension GL_KHR_shader_subgroup_arithmetic : require
+#extension GL_KHR_shader_subgroup_ballot : require
+#extension GL_KHR_shader_subgroup_vote : require
+
+#define WORKGROUP_SIZE 256
+#define ITEMS_PER_THREAD 4
+#define TILE_SIZE (WORKGROUP_SIZE * ITEMS_PER_THREAD)
+// the smallest subgroup size we support is 8
+#define MAX_SUBGROUPS (WORKGROUP_SIZE / 8)
+
+layout(buffer_reference, std430, buffer_reference_align = 4) buffer Words { uint v[]; };
+layout(buffer_reference, std430, buffer_reference_align = 8) buffer Status { uint64_t v[]; };
+
+// tile status words for decoupled lookback: flag in the high half, value in the low half
+const uint FLAG_NOT_READY = 0u;
+const uint FLAG_AGGREGATE = 1u;
+const uint FLAG_PREFIX = 2u;
+
+uint64_t PackStatus(uint flag, uint value) { return (uint64_t(flag) << 32) | uint64_t(value); }
+uint StatusFlag(uint64_t status) { return uint(status >> 32); }
+uint StatusValue(uint64_t status) { return uint(status & 0xFFFFFFFFul); }
+
+// atomics are the only coherent way to read a word another workgroup is publishing
+uint64_t LoadStatus(Status status, uint index) { return atomicOr(status.v[index], 0ul); }
+void StoreStatus(Status status, uint index, uint64_t value) { atomicExchange(status.v[index], value); }
+
+shared uint scanScratch[MAX_SUBGROUPS];
+shared uint scanTotal;
+
+// Exclusive sum over the workgroup. Must be reached in uniform control flow.
+uint WorkgroupExclusiveAdd(uint value, out uint total) {
+    uint inclusive = subgroupInclusiveAdd(value);
+    if (gl_SubgroupInvocationID == gl_SubgroupSize - 1) scanScratch[gl_SubgroupID] = inclusive;
+    barrier();
+
+    if (gl_SubgroupID == 0) {
+        uint running = 0;
+        for (uint base = 0; base < gl_NumSubgroups; base += gl_SubgroupSize) {
+            uint index = base + gl_SubgroupInvocationID;
+            uint partial = index < gl_NumSubgroups ? scanScratch[index] : 0;
+            uint exclusive = subgroupExclusiveAdd(partial) + running;
+            running += subgroupAdd(partial);
+            if (index < gl_NumSubgroups) scanScratch[index] = exclusive;
+        }
+        if (gl_SubgroupInvocationID == 0) scanTotal = running;
+    }
+    barrier();
+
+    total = scanTotal;
+    uint result = scanScratch[gl_SubgroupID] + inclusive - value;
+    barrier();
+    return result;
+}
+
+/*
+ * Decoupled lookback run by a whole subgroup: each lane inspects one predecessor tile, so a
+ * window of gl_SubgroupSize tiles is resolved per iteration. Publishes this tile's inclusive
+ * prefix and returns its exclusive prefix. Call from one subgroup only.
+ */
+uint SubgroupDecoupledLookback(Status status, uint tile, uint aggregate) {
+    if (tile != 0 && subgroupElect()) StoreStatus(status, tile, PackStatus(FLAG_AGGREGATE, aggregate));
+
+    uint exclusive = 0;
+    int window = int(tile) - 1;
+    while (window >= 0) {
+        int index = window - int(gl_SubgroupInvocationID);
+        uint64_t s = index >= 0 ? LoadStatus(status, uint(index)) : PackStatus(FLAG_PREFIX, 0);
+        uint flag = StatusFlag(s);
+
+        uvec4 prefixLanes = subgroupBallot(flag == FLAG_PREFIX);
+        bool foundPrefix = subgroupAny(flag == FLAG_PREFIX);
+        uint stop = foundPrefix ? subgroupBallotFindLSB(prefixLanes) : gl_SubgroupSize - 1;
+        bool contributes = gl_SubgroupInvocationID <= stop;
+
+        // a predecessor inside the window hasn't published yet: spin on the same window
+        if (subgroupAny(contributes && flag == FLAG_NOT_READY)) continue;
+
+        exclusive += subgroupAdd(contributes ? StatusValue(s) : 0);
+        if (foundPrefix) break;
+        window -= int(gl_SubgroupSize);
+    }
+
+    if (subgroupElect()) StoreStatus(status, tile, PackStatus(FLAG_PREFIX, exclusive + aggregate));
+    return exclusive;
+}
+
+// Single-lane variant, used where every lane resolves its own independent chain (radix digits).
+uint LaneDecoupledLookback(Status status, uint tile, uint stride, uint lane, uint aggregate, uint base) {
+    if (tile == 0) {
+        StoreStatus(status, lane, PackStatus(FLAG_PREFIX, base + aggregate));
+        return base;
+    }
+    StoreStatus(status, tile * stride + lane, PackStatus(FLAG_AGGREGATE, aggregate));
+
+    uint exclusive = 0;
+    int look = int(tile) - 1;
+    while (look >= 0) {
+        uint64_t s = LoadStatus(status, uint(look) * stride + lane);
+        uint flag = StatusFlag(s);
+        if (flag == FLAG_NOT_READY) continue;
+        exclusive += StatusValue(s);
+        if (flag == FLAG_PREFIX) break;
+        look--;
+    }
+
+    StoreStatus(status, tile * stride + lane, PackStatus(FLAG_PREFIX, exclusive + aggregate));
+    return exclusive;
+}
@@ -0,0 +1,55 @@
+// Uniform / hashed particle grid shared by the grid build kernels and by simulation kernels
+// that iterate neighbours. Include after common.glsl.
+//
+// After a build, particles are reordered so each cell's particles are contiguous:
+// cell c owns sortedPositions[cellStart[c] .. cellStart[c] + cellCount[c]).
+// The 27 cell neighbourhood is complete only while the query radius is <= the cell size.
+
+layout(buffer_reference, std430, buffer_reference_align = 16) buffer Vec4s { vec4 v[]; };
+
+// dims.x == 0 selects hashing into tableSize buckets, otherwise a dims sized uniform grid
+struct GridParams {
+    vec3 origin;
+    float inverseCellSize;
+    ivec3 dims;
+    uint tableSize;
+};
+
+ivec3 GridCell(GridParams grid, vec3 position) {
+    ivec3 cell = ivec3(floor((position - grid.origin) * grid.inverseCellSize));
+    if (grid.dims.x > 0) cell = clamp(cell, ivec3(0), grid.dims - 1);
+    return cell;
+}
+
+uint GridHash(GridParams grid, ivec3 cell) {
+    uvec3 u = uvec3(cell);
+    return ((u.x * 73856093u) ^ (u.y * 19349663u) ^ (u.z * 83492791u)) % grid.tableSize;
+}
+
+// returns tableSize for cells outside a uniform grid
+uint GridCellIndex(GridParams grid, ivec3 cell) {
+    if (grid.dims.x == 0) return GridHash(grid, cell);
+    if (any(lessThan(cell, ivec3(0))) || any(greaterThanEqual(cell, grid.dims))) return grid.tableSize;
+    return uint(cell.x + grid.dims.x * (cell.y + grid.dims.y * cell.z));
+}
+
+ivec3 GridNeighborOffset(uint n) {
+    return ivec3(int(n % 3) - 1, int((n / 3) % 3) - 1, int(n / 9) - 1);
+}
+
+/*
+ * Sorted index range of the n-th (0..26) cell around cell. Hashed neighbour cells can share a
+ * bucket; the later ones come back empty so no particle is visited twice. Buckets may still hold
+ * particles from unrelated cells, so callers always test the actual distance.
+ */
+uvec2 GridNeighborRange(GridParams grid, Words cellStart, Words cellCount, ivec3 cell, uint n) {
+    uint index = GridCellIndex(grid, cell + GridNeighborOffset(n));
+    if (index >= grid.tableSize) return uvec2(0);
+    if (grid.dims.x == 0) {
+        for (uint earlier = 0; earlier < n; earlier++) {
+            if (GridCellIndex(grid, cell + GridNeighborOffset(earlier)) == index) return uvec2(0);
+        }
+    }
+    uint begin = cellStart.v[index];
+    return uvec2(begin, begin + cellCount.v[index]);
+}
@@ -0,0 +1,59 @@
+// Sparse brick volume lookup shared by compute kernels and the ray-march fragment shader.
+// Needs GL_EXT_buffer_reference and the atlas bound as a sampler3D; no shared memory or
+// subgroup use, so it is safe to include from any stage.
+//
+// Two-level hierarchy: a dense root table over nodes of 16^3 bricks, nodes mapping each brick to
+// an atlas slot. Bricks are 8^3 voxels stored with a one voxel apron (10^3 texels) so hardware
+// trilinear filtering never crosses into a neighbouring slot.
+
+#define BRICK_SIZE 8
+#define BRICK_STORED 10
+#define NODE_BRICKS_PER_AXIS 16
+#define NODE_BRICKS 4096
+#define VOLUME_EMPTY 0xFFFFFFFFu
+
+layout(buffer_reference, std430, buffer_reference_align = 4) readonly buffer VolumeWords { uint v[]; };
+
+layout(buffer_reference, std430, buffer_reference_align = 16) readonly buffer VolumeInfo {
+    ivec3 rootDims;
+    float voxelSize;
+    vec3 origin;
+    float background;
+    ivec3 atlasBricks;
+    uint padding;
+    VolumeWords rootTable;
+    VolumeWords nodePool;
+};
+
+// atlas slot of a brick (in brick coordinates), or VOLUME_EMPTY when it is inactive
+uint VolumeBrickSlot(VolumeInfo volume, ivec3 brick) {
+    ivec3 node = brick >> 4;
+    if (any(lessThan(node, ivec3(0))) || any(greaterThanEqual(node, volume.rootDims))) return VOLUME_EMPTY;
+
+    uint nodeSlot = volume.rootTable.v[node.x + volume.rootDims.x * (node.y + volume.rootDims.y * node.z)];
+    if (nodeSlot == VOLUME_EMPTY) return VOLUME_EMPTY;
+
+    ivec3 local = brick & (NODE_BRICKS_PER_AXIS - 1);
+    return volume.nodePool.v[nodeSlot * NODE_BRICKS + local.x + NODE_BRICKS_PER_AXIS * (local.y + NODE_BRICKS_PER_AXIS * local.z)];
+}
+
+vec3 VolumeVoxelPosition(VolumeInfo volume, vec3 worldPosition) {
+    return (worldPosition - volume.origin) / volume.voxelSize;
+}
+
+ivec3 VolumeBrick(vec3 voxelPosition) {
+    return ivec3(floor(voxelPosition / BRICK_SIZE));
+}
+
+// trilinear sample at a world position; voxel i holds the field at voxel space i + 0.5
+float SampleVolume(VolumeInfo volume, sampler3D atlas, vec3 worldPosition) {
+    vec3 p = VolumeVoxelPosition(volume, worldPosition);
+    ivec3 brick = VolumeBrick(p);
+    uint slot = VolumeBrickSlot(volume, brick);
+    if (slot == VOLUME_EMPTY) return volume.background;
+
+    ivec3 dims = volume.atlasBricks;
+    ivec3 slotCoord = ivec3(int(slot) % dims.x, (int(slot) / dims.x) % dims.y, int(slot) / (dims.x * dims.y));
+    vec3 texel = vec3(slotCoord * BRICK_STORED) + 1.0 + (p - vec3(brick * BRICK_SIZE));
+    return textureLod(atlas, texel / vec3(dims * BRICK_STORED), 0.0).r;
+}
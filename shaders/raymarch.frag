@@ -0,0 +1,63 @@
+#version 460
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_buffer_reference : require
+#include "compute/sparse_volume.glsl"
+
+// Emission-absorption ray march through the sparse volume. Rays jump over inactive bricks in one
+// step, so cost follows the active volume along the ray rather than the domain size.
+
+layout(location = 0) in vec2 ndc;
+layout(location = 0) out vec4 outColor;
+
+layout(set = 0, binding = 0) uniform sampler3D atlas;
+
+layout(push_constant) uniform Params {
+    mat4 inverseViewProjection;
+    vec4 eye;
+    VolumeInfo volume;
+    float stepScale;
+    float densityScale;
+} params;
+
+vec2 IntersectBox(vec3 origin, vec3 inverseDirection, vec3 boxMin, vec3 boxMax) {
+    vec3 t0 = (boxMin - origin) * inverseDirection;
+    vec3 t1 = (boxMax - origin) * inverseDirection;
+    vec3 tMin = min(t0, t1), tMax = max(t0, t1);
+    return vec2(max(max(tMin.x, tMin.y), max(tMin.z, 0.0)), min(min(tMax.x, tMax.y), tMax.z));
+}
+
+vec3 TransferColor(float value) {
+    return mix(vec3(0.1, 0.2, 0.8), vec3(1.0, 0.6, 0.1), clamp(value, 0.0, 1.0));
+}
+
+void main() {
+    VolumeInfo volume = params.volume;
+    vec4 farPoint = params.inverseViewProjection * vec4(ndc, 1.0, 1.0);
+    vec3 origin = params.eye.xyz;
+    vec3 direction = normalize(farPoint.xyz / farPoint.w - origin);
+    vec3 inverseDirection = 1.0 / direction;
+
+    float brickWorld = BRICK_SIZE * volume.voxelSize;
+    vec3 domainMax = volume.origin + vec3(volume.rootDims * NODE_BRICKS_PER_AXIS) * brickWorld;
+    vec2 range = IntersectBox(origin, inverseDirection, volume.origin, domainMax);
+
+    vec4 accumulated = vec4(0.0);
+    float stepLength = volume.voxelSize * params.stepScale;
+    float t = range.x;
+    while (t < range.y && accumulated.a < 0.99) {
+        vec3 position = origin + direction * t;
+        ivec3 brick = VolumeBrick(VolumeVoxelPosition(volume, position));
+        if (VolumeBrickSlot(volume, brick) == VOLUME_EMPTY) {
+            vec3 brickMin = volume.origin + vec3(brick) * brickWorld;
+            t = max(IntersectBox(origin, inverseDirection, brickMin, brickMin + brickWorld).y, t) + stepLength * 0.5;
+            continue;
+        }
+
+        float value = SampleVolume(volume, atlas, position);
+        float alpha = 1.0 - exp(-max(value, 0.0) * params.densityScale * stepLength);
+        accumulated.rgb += (1.0 - accumulated.a) * alpha * TransferColor(value);
+        accumulated.a += (1.0 - accumulated.a) * alpha;
+        t += stepLength;
+    }
+    outColor = accumulated;
+}
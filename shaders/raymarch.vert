@@ -0,0 +1,10 @@
+#version 450
+
+// full-screen triangle; the fragment shader reconstructs view rays from ndc
+layout(location = 0) out vec2 ndc;
+
+void main() {
+    vec2 position = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2) * 2.0 - 1.0;
+    ndc = position;
+    gl_Position = vec4(position, 0.0, 1.0);
+}
@@ -1,4 +1,23 @@
 import subprocess
 
-subprocess.run(["C:\\VulkanSDK\\1.4.313.0\\Bin\\glslc.exe", "./shader.vert", "-o", "vertex.spv"], check=True)
-subprocess.run(["C:\\VulkanSDK\\1.4.313.0\\Bin\\glslc.exe", "./shader.frag", "-o", "fragment.spv"], check=True)
+glslc = "C:\\VulkanSDK\\1.4.313.0\\Bin\\glslc.exe"
+
+subprocess.run([glslc, "./shader.vert", "-o", "vertex.spv"], check=True)
+subprocess.run([glslc, "./shader.frag", "-o", "fragment.spv"], check=True)
+subprocess.run([glslc, "./raymarch.vert", "-o", "raymarch_vertex.spv"], check=True)
+subprocess.run([glslc, "--target-env=vulkan1.2", "./raymarch.frag", "-o", "raymarch_fragment.spv"], check=True)
+
+compute_shaders = [
+    "scan",
+    "compact",
+    "radix_histogram",
+    "radix_offsets",
+    "radix_onesweep",
+    "segmented_reduce",
+    "grid_count",
+    "grid_reorder",
+    "grid_neighbor_count",
+    "volume_sample",
+]
+for name in compute_shaders:
+    subprocess.run([glslc, "--target-env=vulkan1.2", f"./compute/{name}.comp", "-o", f"./compute/{name}.spv"], check=True)
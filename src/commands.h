@@ -0,0 +1,37 @@
+#pragma once
+#include "config.h"
+
+namespace vkInit {
+    vk::CommandPool MakeCommandPool(vk::Device device, uint32_t queueFamilyIndex, bool debug){
+        vk::CommandPoolCreateInfo poolInfo = vk::CommandPoolCreateInfo(
+                vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+                queueFamilyIndex
+        );
+
+        try{
+            vk::CommandPool commandPool = device.createCommandPool(poolInfo);
+            if (debug) std::cout << "allocated command pool" << "\n";
+            return commandPool;
+        }catch(vk::SystemError err){
+            if (debug) std::cerr << "failed to create command pool: " << err.what() << "\n";
+            return nullptr;
+        }
+    }
+
+    vk::CommandBuffer MakeCommandBuffer(vk::Device device, vk::CommandPool commandPool, bool debug){
+        vk::CommandBufferAllocateInfo allocInfo = vk::CommandBufferAllocateInfo(
+                commandPool,
+                vk::CommandBufferLevel::ePrimary,
+                1
+        );
+
+        try{
+            vk::CommandBuffer commandBuffer = device.allocateCommandBuffers(allocInfo)[0];
+            if (debug) std::cout << "allocated command buffer" << "\n";
+            return commandBuffer;
+        }catch(vk::SystemError err){
+            if (debug) std::cerr << "failed to allocate command buffer: " << err.what() << "\n";
+            return nullptr;
+        }
+    }
+}
@@ -0,0 +1,359 @@
+#pragma once
+#include "Primitives.h"
+#include "SpatialGrid.h"
+#include "SparseVolume.h"
+
+#include <chrono>
+#include <iomanip>
+#include <random>
+#include <type_traits>
+
+namespace vkCompute {
+    struct BenchmarkResult {
+        double gpuSeconds;
+        double cpuSeconds;
+        bool matches;
+    };
+
+    template <typename Function>
+    double TimeCpu(Function&& function){
+        auto start = std::chrono::steady_clock::now();
+        function();
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void PrintBenchmark(const std::string& name, uint32_t count, const BenchmarkResult& result){
+        std::cout << std::left << std::setw(24) << name << std::right
+                  << std::setw(10) << count << " keys"
+                  << std::setw(12) << std::fixed << std::setprecision(1) << count / result.gpuSeconds * 1e-6 << " Mkeys/s gpu"
+                  << std::setw(12) << count / result.cpuSeconds * 1e-6 << " Mkeys/s cpu"
+                  << (result.matches ? "" : "   MISMATCH") << "\n";
+    }
+
+    BenchmarkResult BenchmarkScan(Primitives& primitives, const std::vector<uint32_t>& values){
+        uint32_t count = static_cast<uint32_t>(values.size());
+        vk::DeviceSize size = count * sizeof(uint32_t);
+        vkUtil::Buffer input = primitives.MakeBuffer(size, false);
+        vkUtil::Buffer output = primitives.MakeBuffer(size, false);
+        primitives.Upload(input, values.data(), size);
+
+        BenchmarkResult result{};
+        result.gpuSeconds = primitives.Measure([&](vk::CommandBuffer cmd) {
+            primitives.Scan(cmd, input.address, output.address, count, false);
+        });
+        std::vector<uint32_t> expected;
+        result.cpuSeconds = TimeCpu([&] { expected = ScanCpu(values, false); });
+
+        std::vector<uint32_t> actual(count);
+        primitives.Readback(output, actual.data(), size);
+        result.matches = actual == expected;
+
+        primitives.DestroyBuffer(input);
+        primitives.DestroyBuffer(output);
+        return result;
+    }
+
+    BenchmarkResult BenchmarkCompact(Primitives& primitives, const std::vector<uint32_t>& values, const std::vector<uint32_t>& flags){
+        uint32_t count = static_cast<uint32_t>(values.size());
+        vk::DeviceSize size = count * sizeof(uint32_t);
+        vkUtil::Buffer input = primitives.MakeBuffer(size, false);
+        vkUtil::Buffer inputFlags = primitives.MakeBuffer(size, false);
+        vkUtil::Buffer output = primitives.MakeBuffer(size, false);
+        vkUtil::Buffer outputCount = primitives.MakeBuffer(sizeof(uint32_t), false);
+        primitives.Upload(input, values.data(), size);
+        primitives.Upload(inputFlags, flags.data(), size);
+
+        BenchmarkResult result{};
+        result.gpuSeconds = primitives.Measure([&](vk::CommandBuffer cmd) {
+            primitives.Compact(cmd, input.address, inputFlags.address, output.address, outputCount, count);
+        });
+        std::vector<uint32_t> expected;
+        result.cpuSeconds = TimeCpu([&] { expected = CompactCpu(values, flags); });
+
+        uint32_t kept{0};
+        primitives.Readback(outputCount, &kept, sizeof(kept));
+        std::vector<uint32_t> actual(kept);
+        if (kept > 0) primitives.Readback(output, actual.data(), kept * sizeof(uint32_t));
+        result.matches = actual == expected;
+
+        for (vkUtil::Buffer* buffer : {&input, &inputFlags, &output, &outputCount}) primitives.DestroyBuffer(*buffer);
+        return result;
+    }
+
+    template <typename Key>
+    BenchmarkResult BenchmarkRadixSort(Primitives& primitives, const std::vector<Key>& keys, bool withPayload){
+        uint32_t count = static_cast<uint32_t>(keys.size());
+        vk::DeviceSize keySize = count * sizeof(Key);
+        vk::DeviceSize payloadSize = count * sizeof(uint32_t);
+
+        std::vector<uint32_t> payload;
+        if (withPayload){
+            payload.resize(count);
+            for (uint32_t i = 0; i < count; i++) payload[i] = i;
+        }
+
+        vkUtil::Buffer keysBuffer = primitives.MakeBuffer(keySize, false);
+        vkUtil::Buffer keysTemp = primitives.MakeBuffer(keySize, false);
+        vkUtil::Buffer payloadBuffer = primitives.MakeBuffer(payloadSize, false);
+        vkUtil::Buffer payloadTemp = primitives.MakeBuffer(payloadSize, false);
+        primitives.Upload(keysBuffer, keys.data(), keySize);
+        if (withPayload) primitives.Upload(payloadBuffer, payload.data(), payloadSize);
+
+        BenchmarkResult result{};
+        result.gpuSeconds = primitives.Measure([&](vk::CommandBuffer cmd) {
+            primitives.RadixSort(cmd, keysBuffer.address, keysTemp.address,
+                                 withPayload ? payloadBuffer.address : 0, withPayload ? payloadTemp.address : 0,
+                                 count, sizeof(Key) * 8);
+        });
+        std::vector<Key> expectedKeys = keys;
+        std::vector<uint32_t> expectedPayload = payload;
+        result.cpuSeconds = TimeCpu([&] { RadixSortCpu(expectedKeys, expectedPayload); });
+
+        std::vector<Key> actualKeys(count);
+        primitives.Readback(keysBuffer, actualKeys.data(), keySize);
+        result.matches = actualKeys == expectedKeys;
+        if (withPayload){
+            std::vector<uint32_t> actualPayload(count);
+            primitives.Readback(payloadBuffer, actualPayload.data(), payloadSize);
+            result.matches = result.matches && actualPayload == expectedPayload;
+        }
+
+        for (vkUtil::Buffer* buffer : {&keysBuffer, &keysTemp, &payloadBuffer, &payloadTemp}) primitives.DestroyBuffer(*buffer);
+        return result;
+    }
+
+    /*
+     * Float sums may associate differently on the GPU, so they match within a bound scaled by the
+     * segment's magnitude; integer results and float min/max must match exactly.
+     */
+    template <typename T>
+    BenchmarkResult BenchmarkSegmentedReduce(Primitives& primitives, const std::vector<T>& values, const std::vector<uint32_t>& offsets, ReduceOp op){
+        uint32_t count = static_cast<uint32_t>(values.size());
+        uint32_t segmentCount = static_cast<uint32_t>(offsets.size() - 1);
+        vkUtil::Buffer input = primitives.MakeBuffer(count * sizeof(T), false);
+        vkUtil::Buffer inputOffsets = primitives.MakeBuffer(offsets.size() * sizeof(uint32_t), false);
+        vkUtil::Buffer output = primitives.MakeBuffer(segmentCount * sizeof(T), false);
+        primitives.Upload(input, values.data(), count * sizeof(T));
+        primitives.Upload(inputOffsets, offsets.data(), offsets.size() * sizeof(uint32_t));
+
+        constexpr bool floatValues = std::is_floating_point_v<T>;
+        BenchmarkResult result{};
+        result.gpuSeconds = primitives.Measure([&](vk::CommandBuffer cmd) {
+            primitives.SegmentedReduce(cmd, input.address, inputOffsets.address, output.address, segmentCount, op, floatValues);
+        });
+        std::vector<T> expected;
+        result.cpuSeconds = TimeCpu([&] { expected = SegmentedReduceCpu(values, offsets, op); });
+
+        std::vector<T> actual(segmentCount);
+        primitives.Readback(output, actual.data(), segmentCount * sizeof(T));
+        if constexpr (floatValues){
+            std::vector<T> magnitudes(values.size());
+            for (uint32_t i = 0; i < count; i++) magnitudes[i] = std::abs(values[i]);
+            std::vector<T> bounds = SegmentedReduceCpu(magnitudes, offsets, ReduceOp::eAdd);
+
+            result.matches = true;
+            for (uint32_t s = 0; s < segmentCount; s++){
+                T tolerance = op == ReduceOp::eAdd ? bounds[s] * T(1e-5) : T(0);
+                result.matches = result.matches && (actual[s] == expected[s] || std::abs(actual[s] - expected[s]) <= tolerance);
+            }
+        } else {
+            result.matches = actual == expected;
+        }
+
+        for (vkUtil::Buffer* buffer : {&input, &inputOffsets, &output}) primitives.DestroyBuffer(*buffer);
+        return result;
+    }
+
+    /*
+     * One simulation step: grid rebuild plus a neighbour count over every particle. Particles fill
+     * a cube at constant density, so a linear method keeps the per-particle rate flat as count grows.
+     */
+    BenchmarkResult BenchmarkSpatialGrid(Primitives& primitives, SpatialGrid& spatialGrid, const std::vector<Particle>& positions,
+                                         const GridParams& params, float radius){
+        uint32_t count = static_cast<uint32_t>(positions.size());
+        vk::DeviceSize size = count * sizeof(Particle);
+        vkUtil::Buffer input = primitives.MakeBuffer(size, false);
+        vkUtil::Buffer output = primitives.MakeBuffer(count * sizeof(uint32_t), false);
+        primitives.Upload(input, positions.data(), size);
+        spatialGrid.Reserve(count, params.tableSize, false);
+
+        BenchmarkResult result{};
+        result.gpuSeconds = primitives.Measure([&](vk::CommandBuffer cmd) {
+            spatialGrid.Build(cmd, params, input.address, 0, count);
+            spatialGrid.CountNeighbors(cmd, output.address, radius);
+        });
+        std::vector<uint32_t> expected;
+        result.cpuSeconds = TimeCpu([&] {
+            SpatialGridCpu grid(params);
+            grid.Build(positions);
+            expected = grid.CountNeighbors(radius);
+        });
+
+        std::vector<uint32_t> actual(count);
+        primitives.Readback(output, actual.data(), count * sizeof(uint32_t));
+        result.matches = actual == expected;
+
+        primitives.DestroyBuffer(input);
+        primitives.DestroyBuffer(output);
+        return result;
+    }
+
+    bool RunGridBenchmarks(Primitives& primitives, bool debug){
+        std::mt19937 random(4321);
+        SpatialGrid spatialGrid(primitives, debug);
+        bool allMatch = true;
+
+        const float cellSize = 1.0f;
+        const float particlesPerCell = 8.0f;
+        for (uint32_t count : {1u << 14, 1u << 16, 1u << 18, 1u << 20}){
+            int32_t side = static_cast<int32_t>(std::ceil(std::cbrt(count / particlesPerCell)));
+            std::uniform_real_distribution<float> coordinate(0.0f, side * cellSize);
+            std::vector<Particle> positions(count);
+            for (Particle& position : positions) position = {coordinate(random), coordinate(random), coordinate(random), 1.0f};
+
+            const float origin[3] = {0.0f, 0.0f, 0.0f};
+            const int32_t dims[3] = {side, side, side};
+            uint32_t tableSize = 1;
+            while (tableSize < 2 * count) tableSize <<= 1;
+
+            BenchmarkResult uniform = BenchmarkSpatialGrid(primitives, spatialGrid, positions, SpatialGrid::UniformGrid(origin, cellSize, dims), cellSize);
+            BenchmarkResult hashed = BenchmarkSpatialGrid(primitives, spatialGrid, positions, SpatialGrid::HashedGrid(cellSize, tableSize), cellSize);
+            PrintBenchmark("grid step uniform", count, uniform);
+            PrintBenchmark("grid step hashed", count, hashed);
+            allMatch = allMatch && uniform.matches && hashed.matches;
+        }
+        return allMatch;
+    }
+
+    // GPU samples go through half texels and the hardware filter's fixed point weights, hence the tolerance
+    BenchmarkResult BenchmarkVolumeSample(Primitives& primitives, SparseVolume& volume, const std::vector<Particle>& points){
+        uint32_t count = static_cast<uint32_t>(points.size());
+        vkUtil::Buffer input = primitives.MakeBuffer(count * sizeof(Particle), false);
+        vkUtil::Buffer output = primitives.MakeBuffer(count * sizeof(float), false);
+        primitives.Upload(input, points.data(), count * sizeof(Particle));
+
+        BenchmarkResult result{};
+        result.gpuSeconds = primitives.Measure([&](vk::CommandBuffer cmd) {
+            volume.Sample(cmd, input.address, output.address, count);
+        });
+        std::vector<float> expected(count);
+        result.cpuSeconds = TimeCpu([&] {
+            for (uint32_t i = 0; i < count; i++) expected[i] = volume.SampleCpu(points[i].data());
+        });
+
+        std::vector<float> actual(count);
+        primitives.Readback(output, actual.data(), count * sizeof(float));
+        result.matches = true;
+        for (uint32_t i = 0; i < count; i++){
+            result.matches = result.matches && std::abs(actual[i] - expected[i]) <= 1e-2f;
+        }
+
+        primitives.DestroyBuffer(input);
+        primitives.DestroyBuffer(output);
+        return result;
+    }
+
+    /*
+     * A thick spherical shell in a domain of 8^3 nodes (1024^3 voxels), sampled before and after
+     * the inner half of the shell is cleared and pruned, so activation, deactivation and the
+     * streamed table updates are all checked against the host copy.
+     */
+    bool RunVolumeBenchmarks(Primitives& primitives, bool debug){
+        SparseVolumeInput input{{0.0f, 0.0f, 0.0f}, 1.0f, {8, 8, 8}, 1u << 15, 512, 0.0f};
+        SparseVolume volume(primitives, input, debug);
+
+        const float center = 512.0f, radius = 160.0f, thickness = 12.0f;
+        auto shell = [&](float distance) { return std::max(0.0f, 1.0f - std::abs(distance - radius) / thickness); };
+        int32_t low = static_cast<int32_t>(center - radius - thickness) - 1;
+        int32_t high = static_cast<int32_t>(center + radius + thickness) + 1;
+        for (int32_t z = low; z <= high; z++) for (int32_t y = low; y <= high; y++) for (int32_t x = low; x <= high; x++){
+            float dx = x + 0.5f - center, dy = y + 0.5f - center, dz = z + 0.5f - center;
+            float distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+            if (std::abs(distance - radius) < thickness) volume.SetVoxel(x, y, z, shell(distance));
+        }
+        primitives.Submit([&](vk::CommandBuffer cmd) { volume.Flush(cmd); });
+
+        // points near the shell, where most samples land in active bricks and cross brick borders
+        std::mt19937 random(2468);
+        std::normal_distribution<float> direction(0.0f, 1.0f);
+        std::uniform_real_distribution<float> offset(-2.0f * thickness, 2.0f * thickness);
+        const uint32_t count = 1u << 20;
+        std::vector<Particle> points(count);
+        for (Particle& point : points){
+            float d[3] = {direction(random), direction(random), direction(random)};
+            float length = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]) + 1e-6f;
+            float r = radius + offset(random);
+            point = {center + d[0] / length * r, center + d[1] / length * r, center + d[2] / length * r, 1.0f};
+        }
+
+        // the same domain as one dense R16F image
+        double voxelsPerNode = std::pow(static_cast<double>(nodeBricksPerAxis * brickSize), 3.0);
+        double denseBytes = static_cast<double>(input.rootDims[0]) * input.rootDims[1] * input.rootDims[2] * voxelsPerNode * sizeof(uint16_t);
+        BenchmarkResult full = BenchmarkVolumeSample(primitives, volume, points);
+        PrintBenchmark("volume sample", count, full);
+        std::cout << "volume: " << volume.ActiveBricks() << " of " << input.maxBricks << " bricks active, "
+                  << volume.AllocatedBytes() / 1048576.0 << " MiB allocated (atlas grown to the active bricks, and tables; "
+                  << volume.ActiveBytes() / 1048576.0 << " MiB in use) + " << volume.StagingBytes() / 1048576.0 << " MiB staging vs "
+                  << denseBytes / 1048576.0 << " MiB dense\n";
+
+        for (int32_t z = low; z <= high; z++) for (int32_t y = low; y <= high; y++) for (int32_t x = low; x <= high; x++){
+            float dx = x + 0.5f - center, dy = y + 0.5f - center, dz = z + 0.5f - center;
+            if (std::sqrt(dx * dx + dy * dy + dz * dz) < radius) volume.SetVoxel(x, y, z, input.background);
+        }
+        uint32_t pruned = volume.Prune(0.0f);
+        primitives.Submit([&](vk::CommandBuffer cmd) { volume.Flush(cmd); });
+
+        BenchmarkResult half = BenchmarkVolumeSample(primitives, volume, points);
+        PrintBenchmark("volume sample pruned", count, half);
+        if (debug) std::cout << "pruned " << pruned << " bricks, " << volume.ActiveBricks() << " remain\n";
+        return full.matches && half.matches;
+    }
+
+    // validates every primitive against its CPU reference and reports throughput in keys per second
+    bool RunBenchmarks(Primitives& primitives, bool debug){
+        std::mt19937_64 random(1234);
+        bool allMatch = true;
+
+        for (uint32_t count : {1u << 16, 1u << 20, 1u << 24}){
+            primitives.Reserve(count);
+            if (debug) std::cout << "benchmarking compute primitives with " << count << " elements\n";
+
+            std::vector<uint32_t> values(count), flags(count);
+            std::vector<uint64_t> wideKeys(count);
+            std::vector<float> floatValues(count);
+            std::uniform_real_distribution<float> floatDistribution(-1000.0f, 1000.0f);
+            for (uint32_t i = 0; i < count; i++){
+                uint64_t bits = random();
+                values[i] = static_cast<uint32_t>(bits) & 0xFFFF;
+                flags[i] = (bits >> 32) & 1;
+                wideKeys[i] = random();
+                floatValues[i] = floatDistribution(random);
+            }
+            std::vector<uint32_t> keys(count);
+            for (uint32_t i = 0; i < count; i++) keys[i] = static_cast<uint32_t>(wideKeys[i] >> 17);
+
+            // segments of random length up to 4096
+            std::vector<uint32_t> offsets = {0};
+            while (offsets.back() < count){
+                offsets.push_back(std::min<uint32_t>(count, offsets.back() + 1 + static_cast<uint32_t>(random() % 4096)));
+            }
+
+            std::vector<std::pair<std::string, BenchmarkResult>> results;
+            results.emplace_back("scan", BenchmarkScan(primitives, values));
+            results.emplace_back("compact", BenchmarkCompact(primitives, values, flags));
+            results.emplace_back("radix sort u32", BenchmarkRadixSort(primitives, keys, false));
+            results.emplace_back("radix sort u32+payload", BenchmarkRadixSort(primitives, keys, true));
+            results.emplace_back("radix sort u64+payload", BenchmarkRadixSort(primitives, wideKeys, true));
+            for (auto [op, opName] : {std::pair{ReduceOp::eAdd, "add"}, std::pair{ReduceOp::eMin, "min"}, std::pair{ReduceOp::eMax, "max"}}){
+                results.emplace_back(std::string("reduce u32 ") + opName, BenchmarkSegmentedReduce(primitives, values, offsets, op));
+                results.emplace_back(std::string("reduce f32 ") + opName, BenchmarkSegmentedReduce(primitives, floatValues, offsets, op));
+            }
+
+            for (const auto& [name, result] : results){
+                PrintBenchmark(name, count, result);
+                allMatch = allMatch && result.matches;
+            }
+        }
+        return allMatch;
+    }
+}
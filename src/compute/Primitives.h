@@ -0,0 +1,376 @@
+#pragma once
+#include "../config.h"
+#include "../metrics.h"
+#include "../pipeline.h"
+#include "../commands.h"
+#include "../vkUtil/Memory.h"
+#include "Reference.h"
+
+#include <cstring>
+#include <functional>
+
+namespace vkCompute {
+    // must match WORKGROUP_SIZE and TILE_SIZE in shaders/compute/common.glsl
+    constexpr uint32_t workgroupSize = 256;
+    constexpr uint32_t tileSize = 1024;
+    constexpr uint32_t maxWorkgroupsX = 65535;
+
+    // push constant blocks, laid out like the shader declarations
+    struct ScanParams {
+        vk::DeviceAddress values, result, status, tileCounter;
+        uint32_t count, inclusive;
+    };
+
+    struct CompactParams {
+        vk::DeviceAddress values, flags, result, resultCount, status, tileCounter;
+        uint32_t count, padding;
+    };
+
+    struct RadixHistogramParams {
+        vk::DeviceAddress keys, histogram;
+        uint32_t count, passCount;
+    };
+
+    struct RadixOffsetsParams {
+        vk::DeviceAddress histogram;
+    };
+
+    struct RadixOnesweepParams {
+        vk::DeviceAddress keysIn, keysOut, payloadIn, payloadOut, digitOffsets, status, tileCounter;
+        uint32_t count, pass, hasPayload, padding;
+    };
+
+    struct SegmentedReduceParams {
+        vk::DeviceAddress values, offsets, result;
+        uint32_t segmentCount, op;
+    };
+
+    /*
+     * GPU parallel primitives over buffer device addresses: single-pass scan and compaction
+     * (decoupled lookback), onesweep radix sort for 32/64 bit keys with optional uint payloads,
+     * and segmented reductions.
+     *
+     * Operations record into a caller-provided command buffer and are ordered against whatever
+     * was recorded before them, so several can be chained in one submission. They share one
+     * scratch area sized by Reserve(); counts beyond the reservation throw.
+     */
+    class Primitives {
+    public:
+        Primitives(vk::PhysicalDevice physicalDevice, vk::Device device, vk::Queue queue, uint32_t queueFamilyIndex,
+                   metrics::EngineMetrics& engineMetrics, bool debug)
+            : physicalDevice(physicalDevice), device(device), queue(queue), engineMetrics(engineMetrics), debug(debug) {
+            if (debug) std::cout << "making compute primitives" << "\n";
+
+            // a missing or broken kernel, or any later failure, throws after releasing what was made so far
+            try{
+                scan = MakePipeline("scan", sizeof(ScanParams), {});
+                compact = MakePipeline("compact", sizeof(CompactParams), {});
+                radixHistogram32 = MakePipeline("radix_histogram", sizeof(RadixHistogramParams), {1});
+                radixHistogram64 = MakePipeline("radix_histogram", sizeof(RadixHistogramParams), {2});
+                radixOffsets = MakePipeline("radix_offsets", sizeof(RadixOffsetsParams), {});
+                radixOnesweep32 = MakePipeline("radix_onesweep", sizeof(RadixOnesweepParams), {1});
+                radixOnesweep64 = MakePipeline("radix_onesweep", sizeof(RadixOnesweepParams), {2});
+                reduceUint = MakePipeline("segmented_reduce", sizeof(SegmentedReduceParams), {0});
+                reduceFloat = MakePipeline("segmented_reduce", sizeof(SegmentedReduceParams), {1});
+
+                commandPool = vkInit::MakeCommandPool(device, queueFamilyIndex, debug);
+                commandBuffer = vkInit::MakeCommandBuffer(device, commandPool, debug);
+                fence = device.createFence(vk::FenceCreateInfo());
+
+                vk::PhysicalDeviceProperties properties = physicalDevice.getProperties();
+                uint32_t timestampBits = physicalDevice.getQueueFamilyProperties()[queueFamilyIndex].timestampValidBits;
+                if (timestampBits > 0 && properties.limits.timestampComputeAndGraphics){
+                    timestampPeriod = properties.limits.timestampPeriod;
+                    queryPool = device.createQueryPool(vk::QueryPoolCreateInfo(vk::QueryPoolCreateFlags(), vk::QueryType::eTimestamp, 2));
+                }
+
+                counters = MakeBuffer(64, false);
+                histogram = MakeBuffer(8 * 256 * sizeof(uint32_t), false);
+            }catch(...){
+                Release();
+                throw;
+            }
+        }
+
+        ~Primitives() {
+            device.waitIdle();
+            Release();
+        }
+
+        Primitives(const Primitives&) = delete;
+        Primitives& operator=(const Primitives&) = delete;
+
+        // sizes the lookback scratch and the staging buffer for operations over up to maxCount elements
+        void Reserve(uint32_t maxCount) {
+            ReserveStaging(static_cast<vk::DeviceSize>(maxCount) * sizeof(uint64_t));
+            uint32_t tiles = TileCount(maxCount);
+            vk::DeviceSize size = static_cast<vk::DeviceSize>(tiles) * 256 * sizeof(uint64_t);
+            if (status.buffer && status.size >= size){
+                reservedCount = std::max(reservedCount, maxCount);
+                return;
+            }
+
+            if (status.buffer){
+                device.waitIdle();
+                DestroyBuffer(status);
+            }
+            status = MakeBuffer(size, false);
+            reservedCount = maxCount;
+        }
+
+        // storage buffer usable by every primitive; host visible buffers are persistently mapped
+        vkUtil::Buffer MakeBuffer(vk::DeviceSize size, bool hostVisible) {
+            vkUtil::BufferInput input;
+            input.size = std::max<vk::DeviceSize>(size, 4);
+            input.usage = vk::BufferUsageFlagBits::eStorageBuffer
+                    | vk::BufferUsageFlagBits::eTransferSrc
+                    | vk::BufferUsageFlagBits::eTransferDst
+                    | vk::BufferUsageFlagBits::eShaderDeviceAddress;
+            input.properties = hostVisible
+                    ? vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent
+                    : vk::MemoryPropertyFlagBits::eDeviceLocal;
+            input.physicalDevice = physicalDevice;
+            input.device = device;
+
+            vkUtil::Buffer buffer = vkUtil::CreateBuffer(input);
+            engineMetrics.allocatedDeviceBytes->Add(static_cast<int64_t>(buffer.size));
+            return buffer;
+        }
+
+        void DestroyBuffer(vkUtil::Buffer& buffer) {
+            engineMetrics.allocatedDeviceBytes->Add(-static_cast<int64_t>(buffer.size));
+            vkUtil::DestroyBuffer(device, buffer);
+        }
+
+        // both go through the shared staging buffer, which grows when a transfer outsizes the reservation
+        void Upload(const vkUtil::Buffer& destination, const void* data, vk::DeviceSize size) {
+            ReserveStaging(size);
+            std::memcpy(staging.mapped, data, size);
+            Submit([&](vk::CommandBuffer cmd) {
+                cmd.copyBuffer(staging.buffer, destination.buffer, vk::BufferCopy(0, 0, size));
+            });
+            engineMetrics.uploadBytes->Add(size);
+        }
+
+        void Readback(const vkUtil::Buffer& source, void* data, vk::DeviceSize size) {
+            ReserveStaging(size);
+            Submit([&](vk::CommandBuffer cmd) {
+                cmd.copyBuffer(source.buffer, staging.buffer, vk::BufferCopy(0, 0, size));
+            });
+            std::memcpy(data, staging.mapped, size);
+            engineMetrics.readbackBytes->Add(size);
+        }
+
+        // records through record, submits and blocks until the queue has finished it
+        void Submit(const std::function<void(vk::CommandBuffer)>& record) {
+            commandBuffer.reset();
+            commandBuffer.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+            record(commandBuffer);
+            commandBuffer.end();
+
+            vk::SubmitInfo submitInfo = vk::SubmitInfo(0, nullptr, nullptr, 1, &commandBuffer);
+            {
+                metrics::ScopedTimer timer(*engineMetrics.queueSubmitLatency);
+                queue.submit(submitInfo, fence);
+            }
+            if (device.waitForFences(fence, VK_TRUE, UINT64_MAX) != vk::Result::eSuccess){
+                throw std::runtime_error("failed waiting for compute submission");
+            }
+            device.resetFences(fence);
+        }
+
+        // like Submit, returning the GPU time of the recorded work in seconds (wall time without timestamps)
+        double Measure(const std::function<void(vk::CommandBuffer)>& record) {
+            if (!queryPool){
+                auto start = std::chrono::steady_clock::now();
+                Submit(record);
+                return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            }
+
+            Submit([&](vk::CommandBuffer cmd) {
+                cmd.resetQueryPool(queryPool, 0, 2);
+                cmd.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, queryPool, 0);
+                record(cmd);
+                cmd.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, queryPool, 1);
+            });
+            std::array<uint64_t, 2> timestamps{};
+            vk::Result result = device.getQueryPoolResults(queryPool, 0, 2, sizeof(timestamps), timestamps.data(),
+                                                           sizeof(uint64_t), vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait);
+            if (result != vk::Result::eSuccess) return 0.0;
+            return static_cast<double>(timestamps[1] - timestamps[0]) * timestampPeriod * 1e-9;
+        }
+
+        void Scan(vk::CommandBuffer cmd, vk::DeviceAddress values, vk::DeviceAddress result, uint32_t count, bool inclusive) {
+            if (count == 0) return;
+            uint32_t tiles = TileCount(count);
+            ResetLookback(cmd, tiles, 1);
+
+            ScanParams params{values, result, status.address, counters.address, count, inclusive ? 1u : 0u};
+            Dispatch(cmd, scan, &params, sizeof(params), tiles);
+        }
+
+        // resultCount receives the number of surviving elements as a single uint
+        void Compact(vk::CommandBuffer cmd, vk::DeviceAddress values, vk::DeviceAddress flags, vk::DeviceAddress result,
+                     const vkUtil::Buffer& resultCount, uint32_t count) {
+            if (count == 0){
+                Barrier(cmd);
+                cmd.fillBuffer(resultCount.buffer, 0, sizeof(uint32_t), 0);
+                return;
+            }
+            uint32_t tiles = TileCount(count);
+            ResetLookback(cmd, tiles, 1);
+
+            CompactParams params{values, flags, result, resultCount.address, status.address, counters.address, count, 0};
+            Dispatch(cmd, compact, &params, sizeof(params), tiles);
+        }
+
+        /*
+         * Sorts count keys of keyBits (32 or 64) ascending, carrying an optional uint payload
+         * (pass 0 addresses to sort keys only). keysTemp/payloadTemp are ping-pong buffers of
+         * the same size; as the pass count is even the sorted data ends up in keys/payload.
+         */
+        void RadixSort(vk::CommandBuffer cmd, vk::DeviceAddress keys, vk::DeviceAddress keysTemp,
+                       vk::DeviceAddress payload, vk::DeviceAddress payloadTemp, uint32_t count, uint32_t keyBits) {
+            if (count == 0) return;
+            if (keyBits != 32 && keyBits != 64) throw std::invalid_argument("radix sort supports 32 and 64 bit keys");
+            uint32_t tiles = TileCount(count);
+            uint32_t passCount = keyBits / 8;
+            bool wide = keyBits == 64;
+
+            Barrier(cmd);
+            cmd.fillBuffer(histogram.buffer, 0, VK_WHOLE_SIZE, 0);
+            Barrier(cmd);
+
+            RadixHistogramParams histogramParams{keys, histogram.address, count, passCount};
+            Dispatch(cmd, wide ? radixHistogram64 : radixHistogram32, &histogramParams, sizeof(histogramParams), tiles);
+            Barrier(cmd);
+
+            RadixOffsetsParams offsetsParams{histogram.address};
+            cmd.bindPipeline(vk::PipelineBindPoint::eCompute, radixOffsets.pipeline);
+            cmd.pushConstants(radixOffsets.layout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(offsetsParams), &offsetsParams);
+            cmd.dispatch(passCount, 1, 1);
+
+            vk::DeviceAddress keysIn = keys, keysOut = keysTemp;
+            vk::DeviceAddress payloadIn = payload, payloadOut = payloadTemp;
+            for (uint32_t pass = 0; pass < passCount; pass++){
+                ResetLookback(cmd, tiles, 256);
+
+                RadixOnesweepParams params{keysIn, keysOut, payloadIn, payloadOut, histogram.address,
+                                           status.address, counters.address, count, pass, payload != 0 ? 1u : 0u, 0};
+                Dispatch(cmd, wide ? radixOnesweep64 : radixOnesweep32, &params, sizeof(params), tiles);
+
+                std::swap(keysIn, keysOut);
+                std::swap(payloadIn, payloadOut);
+            }
+        }
+
+        // offsets holds segmentCount + 1 uints; float selects float instead of uint values
+        void SegmentedReduce(vk::CommandBuffer cmd, vk::DeviceAddress values, vk::DeviceAddress offsets,
+                             vk::DeviceAddress result, uint32_t segmentCount, ReduceOp op, bool floatValues) {
+            if (segmentCount == 0) return;
+            Barrier(cmd);
+
+            SegmentedReduceParams params{values, offsets, result, segmentCount, static_cast<uint32_t>(op)};
+            Dispatch(cmd, floatValues ? reduceFloat : reduceUint, &params, sizeof(params), segmentCount);
+        }
+
+        // orders everything recorded so far against what follows
+        static void Barrier(vk::CommandBuffer cmd) {
+            vk::MemoryBarrier barrier = vk::MemoryBarrier(
+                    vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eTransferWrite,
+                    vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eTransferWrite
+            );
+            vk::PipelineStageFlags stages = vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eTransfer;
+            cmd.pipelineBarrier(stages, stages, vk::DependencyFlags(), barrier, nullptr, nullptr);
+        }
+
+        static uint32_t TileCount(uint32_t count) { return (count + tileSize - 1) / tileSize; }
+
+        // for modules layered on the primitives (shaders/compute/<name>.spv)
+        vkInit::ComputePipelineOutBundle MakePipeline(const std::string& name, uint32_t pushConstantSize, std::vector<uint32_t> specialization,
+                                                      std::vector<vk::DescriptorSetLayout> setLayouts = {}) {
+            vkInit::ComputePipelineInBundle specification;
+            specification.device = device;
+            specification.shaderFilepath = "shaders/compute/" + name + ".spv";
+            specification.pushConstantSize = pushConstantSize;
+            specification.specializationConstants = std::move(specialization);
+            specification.setLayouts = std::move(setLayouts);
+            vkInit::ComputePipelineOutBundle bundle = vkInit::MakeComputePipeline(specification, debug);
+            engineMetrics.pipelinesCreated->Add();
+            return bundle;
+        }
+
+        vk::PhysicalDevice PhysicalDevice() const { return physicalDevice; }
+        vk::Device Device() const { return device; }
+        metrics::EngineMetrics& Metrics() { return engineMetrics; }
+
+        void DestroyPipeline(vkInit::ComputePipelineOutBundle& bundle) {
+            device.destroyPipeline(bundle.pipeline);
+            device.destroyPipelineLayout(bundle.layout);
+        }
+
+        // spreads workgroups over a 2D grid once they exceed the per-dimension limit
+        static void Dispatch(vk::CommandBuffer cmd, const vkInit::ComputePipelineOutBundle& bundle,
+                             const void* params, uint32_t paramsSize, uint32_t workgroups) {
+            cmd.bindPipeline(vk::PipelineBindPoint::eCompute, bundle.pipeline);
+            cmd.pushConstants(bundle.layout, vk::ShaderStageFlagBits::eCompute, 0, paramsSize, params);
+            uint32_t x = std::min(workgroups, maxWorkgroupsX);
+            cmd.dispatch(x, (workgroups + x - 1) / x, 1);
+        }
+
+    private:
+        // destroys whatever exists, so a partly constructed object can be released too
+        void Release() {
+            for (vkUtil::Buffer* buffer : {&counters, &histogram, &status, &staging}){
+                if (buffer->buffer) DestroyBuffer(*buffer);
+            }
+
+            if (queryPool) device.destroyQueryPool(queryPool);
+            if (fence) device.destroyFence(fence);
+            if (commandPool) device.destroyCommandPool(commandPool);
+
+            for (vkInit::ComputePipelineOutBundle* bundle : {&scan, &compact, &radixHistogram32, &radixHistogram64,
+                                                             &radixOffsets, &radixOnesweep32, &radixOnesweep64,
+                                                             &reduceUint, &reduceFloat}){
+                DestroyPipeline(*bundle);
+            }
+        }
+
+        // Upload and Readback wait for their submission, so one buffer serves every transfer
+        void ReserveStaging(vk::DeviceSize size) {
+            if (staging.buffer && staging.size >= size) return;
+            if (staging.buffer) DestroyBuffer(staging);
+            staging = MakeBuffer(size, true);
+        }
+
+        vk::PhysicalDevice physicalDevice;
+        vk::Device device;
+        vk::Queue queue;
+        metrics::EngineMetrics& engineMetrics;
+        bool debug;
+
+        vkInit::ComputePipelineOutBundle scan, compact;
+        vkInit::ComputePipelineOutBundle radixHistogram32, radixHistogram64, radixOffsets, radixOnesweep32, radixOnesweep64;
+        vkInit::ComputePipelineOutBundle reduceUint, reduceFloat;
+
+        vk::CommandPool commandPool{nullptr};
+        vk::CommandBuffer commandBuffer{nullptr};
+        vk::Fence fence{nullptr};
+        vk::QueryPool queryPool{nullptr};
+        float timestampPeriod{1.0f};
+
+        // counters[0] hands out tile indices; status holds the lookback words; staging carries Upload/Readback
+        vkUtil::Buffer counters, histogram, status, staging;
+        uint32_t reservedCount{0};
+
+        void ResetLookback(vk::CommandBuffer cmd, uint32_t tiles, uint32_t lanes) {
+            if (!status.buffer || TileCount(reservedCount) < tiles){
+                throw std::length_error("compute primitives used beyond their reserved element count");
+            }
+            Barrier(cmd);
+            cmd.fillBuffer(status.buffer, 0, static_cast<vk::DeviceSize>(tiles) * lanes * sizeof(uint64_t), 0);
+            cmd.fillBuffer(counters.buffer, 0, sizeof(uint32_t), 0);
+            Barrier(cmd);
+        }
+    };
+}
@@ -0,0 +1,228 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+/*
+ * CPU reference implementations of the compute primitives. They define the expected results
+ * the GPU kernels are validated against and the baseline the benchmarks compare with.
+ */
+namespace vkCompute {
+    enum class ReduceOp : uint32_t {
+        eAdd = 0,
+        eMin = 1,
+        eMax = 2
+    };
+
+    template <typename T>
+    std::vector<T> ScanCpu(const std::vector<T>& values, bool inclusive){
+        std::vector<T> result(values.size());
+        T running{0};
+        for (size_t i = 0; i < values.size(); i++){
+            if (!inclusive) result[i] = running;
+            running += values[i];
+            if (inclusive) result[i] = running;
+        }
+        return result;
+    }
+
+    template <typename T>
+    std::vector<T> CompactCpu(const std::vector<T>& values, const std::vector<uint32_t>& flags){
+        std::vector<T> result;
+        for (size_t i = 0; i < values.size(); i++){
+            if (flags[i] != 0) result.push_back(values[i]);
+        }
+        return result;
+    }
+
+    /*
+     * LSD radix sort over 8 bit digits, stable, mirroring the GPU pass structure. Key is uint32_t
+     * or uint64_t; payload may be empty.
+     */
+    template <typename Key>
+    void RadixSortCpu(std::vector<Key>& keys, std::vector<uint32_t>& payload){
+        const bool hasPayload = !payload.empty();
+        std::vector<Key> keysTemp(keys.size());
+        std::vector<uint32_t> payloadTemp(payload.size());
+
+        for (uint32_t shift = 0; shift < sizeof(Key) * 8; shift += 8){
+            size_t offsets[256] = {};
+            for (Key key : keys) offsets[(key >> shift) & 0xFF]++;
+
+            size_t running = 0;
+            for (size_t& offset : offsets){
+                size_t count = offset;
+                offset = running;
+                running += count;
+            }
+
+            for (size_t i = 0; i < keys.size(); i++){
+                size_t destination = offsets[(keys[i] >> shift) & 0xFF]++;
+                keysTemp[destination] = keys[i];
+                if (hasPayload) payloadTemp[destination] = payload[i];
+            }
+            keys.swap(keysTemp);
+            if (hasPayload) payload.swap(payloadTemp);
+        }
+    }
+
+    template <typename T>
+    T ReduceIdentity(ReduceOp op){
+        if (op == ReduceOp::eMin) return std::numeric_limits<T>::has_infinity ? std::numeric_limits<T>::infinity() : std::numeric_limits<T>::max();
+        if (op == ReduceOp::eMax) return std::numeric_limits<T>::has_infinity ? -std::numeric_limits<T>::infinity() : std::numeric_limits<T>::lowest();
+        return T{0};
+    }
+
+    template <typename T>
+    T ReduceCombine(ReduceOp op, T a, T b){
+        if (op == ReduceOp::eMin) return std::min(a, b);
+        if (op == ReduceOp::eMax) return std::max(a, b);
+        return a + b;
+    }
+
+    // offsets holds segmentCount + 1 entries; segment s covers [offsets[s], offsets[s + 1])
+    template <typename T>
+    std::vector<T> SegmentedReduceCpu(const std::vector<T>& values, const std::vector<uint32_t>& offsets, ReduceOp op){
+        std::vector<T> result(offsets.empty() ? 0 : offsets.size() - 1);
+        for (size_t s = 0; s < result.size(); s++){
+            T accumulator = ReduceIdentity<T>(op);
+            for (uint32_t i = offsets[s]; i < offsets[s + 1]; i++) accumulator = ReduceCombine(op, accumulator, values[i]);
+            result[s] = accumulator;
+        }
+        return result;
+    }
+
+    // IEEE half, round to nearest even
+    inline uint16_t FloatToHalf(float value){
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        uint32_t sign = (bits >> 16) & 0x8000;
+        uint32_t magnitude = bits & 0x7FFFFFFF;
+
+        if (magnitude >= 0x7F800000) return static_cast<uint16_t>(sign | 0x7C00 | (magnitude > 0x7F800000 ? 0x200 : 0));
+        if (magnitude >= 0x477FF000) return static_cast<uint16_t>(sign | 0x7C00);
+        if (magnitude < 0x38800000){
+            if (magnitude < 0x33000000) return static_cast<uint16_t>(sign);
+            uint32_t shift = 126 - (magnitude >> 23);
+            uint32_t mantissa = (magnitude & 0x7FFFFF) | 0x800000;
+            uint32_t half = mantissa >> shift;
+            uint32_t remainder = mantissa & ((1u << shift) - 1);
+            uint32_t halfway = 1u << (shift - 1);
+            if (remainder > halfway || (remainder == halfway && (half & 1))) half++;
+            return static_cast<uint16_t>(sign | half);
+        }
+
+        uint32_t half = (magnitude - 0x38000000) >> 13;
+        uint32_t remainder = magnitude & 0x1FFF;
+        if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) half++;
+        return static_cast<uint16_t>(sign | half);
+    }
+
+    // mirrors GridParams in shaders/compute/grid_common.glsl; dims[0] == 0 selects hashing
+    struct GridParams {
+        float origin[3];
+        float inverseCellSize;
+        int32_t dims[3];
+        uint32_t tableSize;
+    };
+
+    using Particle = std::array<float, 4>;
+
+    /*
+     * CPU counterpart of vkCompute::SpatialGrid: same cell mapping and counting sort, with ranks
+     * assigned in particle order, so cell contents match the GPU build up to order within a cell.
+     */
+    class SpatialGridCpu {
+    public:
+        explicit SpatialGridCpu(const GridParams& params) : params(params), cellStart(params.tableSize), cellCount(params.tableSize) {}
+
+        std::array<int32_t, 3> Cell(const Particle& position) const {
+            std::array<int32_t, 3> cell{};
+            for (int axis = 0; axis < 3; axis++){
+                cell[axis] = static_cast<int32_t>(std::floor((position[axis] - params.origin[axis]) * params.inverseCellSize));
+                if (params.dims[0] > 0) cell[axis] = std::clamp(cell[axis], 0, params.dims[axis] - 1);
+            }
+            return cell;
+        }
+
+        // returns tableSize for cells outside a uniform grid
+        uint32_t CellIndex(const std::array<int32_t, 3>& cell) const {
+            if (params.dims[0] == 0){
+                uint32_t x = static_cast<uint32_t>(cell[0]), y = static_cast<uint32_t>(cell[1]), z = static_cast<uint32_t>(cell[2]);
+                return ((x * 73856093u) ^ (y * 19349663u) ^ (z * 83492791u)) % params.tableSize;
+            }
+            for (int axis = 0; axis < 3; axis++){
+                if (cell[axis] < 0 || cell[axis] >= params.dims[axis]) return params.tableSize;
+            }
+            return static_cast<uint32_t>(cell[0] + params.dims[0] * (cell[1] + params.dims[1] * cell[2]));
+        }
+
+        void Build(const std::vector<Particle>& positions){
+            std::fill(cellCount.begin(), cellCount.end(), 0);
+            std::vector<uint32_t> cellOf(positions.size());
+            for (size_t i = 0; i < positions.size(); i++){
+                cellOf[i] = CellIndex(Cell(positions[i]));
+                cellCount[cellOf[i]]++;
+            }
+
+            uint32_t running = 0;
+            for (uint32_t c = 0; c < params.tableSize; c++){
+                cellStart[c] = running;
+                running += cellCount[c];
+            }
+
+            std::vector<uint32_t> cursor = cellStart;
+            sortedPositions.resize(positions.size());
+            sortedToOriginal.resize(positions.size());
+            for (size_t i = 0; i < positions.size(); i++){
+                uint32_t destination = cursor[cellOf[i]]++;
+                sortedPositions[destination] = positions[i];
+                sortedToOriginal[destination] = static_cast<uint32_t>(i);
+            }
+        }
+
+        // calls visit(sortedIndex) for every particle in the 27 cells around position
+        template <typename Visit>
+        void ForEachNeighbor(const Particle& position, Visit&& visit) const {
+            std::array<int32_t, 3> cell = Cell(position);
+            std::array<uint32_t, 27> visited{};
+            for (uint32_t n = 0; n < 27; n++){
+                std::array<int32_t, 3> neighbor = {cell[0] + static_cast<int32_t>(n % 3) - 1,
+                                                   cell[1] + static_cast<int32_t>((n / 3) % 3) - 1,
+                                                   cell[2] + static_cast<int32_t>(n / 9) - 1};
+                uint32_t index = CellIndex(neighbor);
+                visited[n] = index;
+                if (index >= params.tableSize) continue;
+                if (std::find(visited.begin(), visited.begin() + n, index) != visited.begin() + n) continue;
+                for (uint32_t j = cellStart[index]; j < cellStart[index] + cellCount[index]; j++) visit(j);
+            }
+        }
+
+        // same contract as grid_neighbor_count.comp: counts in original particle order
+        std::vector<uint32_t> CountNeighbors(float radius) const {
+            std::vector<uint32_t> result(sortedPositions.size());
+            float radiusSquared = radius * radius;
+            for (uint32_t i = 0; i < sortedPositions.size(); i++){
+                const Particle& position = sortedPositions[i];
+                uint32_t neighbors = 0;
+                ForEachNeighbor(position, [&](uint32_t j) {
+                    float dx = sortedPositions[j][0] - position[0];
+                    float dy = sortedPositions[j][1] - position[1];
+                    float dz = sortedPositions[j][2] - position[2];
+                    if (j != i && dx * dx + dy * dy + dz * dz <= radiusSquared) neighbors++;
+                });
+                result[sortedToOriginal[i]] = neighbors;
+            }
+            return result;
+        }
+
+        GridParams params;
+        std::vector<uint32_t> cellStart, cellCount;
+        std::vector<Particle> sortedPositions;
+        std::vector<uint32_t> sortedToOriginal;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,639 @@
+#pragma once
+#include "Primitives.h"
+#include "../descriptors.h"
+
+#include <array>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace vkCompute {
+    // must match shaders/compute/sparse_volume.glsl
+    constexpr int32_t brickSize = 8;
+    constexpr int32_t brickStored = brickSize + 2;
+    constexpr int32_t nodeBricksPerAxis = 16;
+    constexpr uint32_t nodeBricks = nodeBricksPerAxis * nodeBricksPerAxis * nodeBricksPerAxis;
+    constexpr uint32_t volumeEmpty = 0xFFFFFFFFu;
+
+    struct VolumeInfo {
+        int32_t rootDims[3];
+        float voxelSize;
+        float origin[3];
+        float background;
+        int32_t atlasBricks[3];
+        uint32_t padding;
+        vk::DeviceAddress rootTable, nodePool;
+    };
+    static_assert(sizeof(VolumeInfo) == 64, "VolumeInfo must match the shader block");
+
+    struct VolumeSampleParams {
+        vk::DeviceAddress volume, points, result;
+        uint32_t count, padding;
+    };
+
+    // push constants of shaders/raymarch.frag
+    struct RaymarchParams {
+        float inverseViewProjection[16];
+        float eye[4];
+        vk::DeviceAddress volume;
+        float stepScale;
+        float densityScale;
+    };
+
+    /*
+     * The matrix the ray march reads as inverseViewProjection. It maps ndc (x, y, 1, 1) to a far
+     * point one unit ahead of eye, which is all the shader needs to rebuild view rays, so no
+     * general 4x4 inverse is required. verticalFov is in radians; out is column-major.
+     */
+    inline void CameraRayMatrix(const float eye[3], const float target[3], float verticalFov, float aspect, float out[16]){
+        auto normalize = [](std::array<float, 3> v) {
+            float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+            return length > 0.0f ? std::array<float, 3>{v[0] / length, v[1] / length, v[2] / length} : v;
+        };
+        auto cross = [](const std::array<float, 3>& a, const std::array<float, 3>& b) {
+            return std::array<float, 3>{a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]};
+        };
+
+        std::array<float, 3> forward = normalize({target[0] - eye[0], target[1] - eye[1], target[2] - eye[2]});
+        std::array<float, 3> right = normalize(cross(forward, {0.0f, 1.0f, 0.0f}));
+        if (right == std::array<float, 3>{0.0f, 0.0f, 0.0f}) right = {1.0f, 0.0f, 0.0f};
+        std::array<float, 3> up = cross(right, forward);
+
+        // Vulkan ndc y points down the screen
+        float halfHeight = std::tan(verticalFov * 0.5f), halfWidth = halfHeight * aspect;
+        for (int axis = 0; axis < 3; axis++){
+            out[axis] = right[axis] * halfWidth;
+            out[4 + axis] = -up[axis] * halfHeight;
+            out[8 + axis] = forward[axis];
+            out[12 + axis] = eye[axis];
+        }
+        out[3] = out[7] = out[11] = 0.0f;
+        out[15] = 1.0f;
+    }
+
+    struct SparseVolumeInput {
+        float origin[3];
+        float voxelSize;
+        // domain in nodes of 16^3 bricks of 8^3 voxels
+        int32_t rootDims[3];
+        // most bricks the atlas grows to; it starts at one layer of slots and doubles as bricks activate
+        uint32_t maxBricks;
+        uint32_t maxNodes;
+        float background;
+    };
+
+    /*
+     * VDB-style sparse scalar field. A dense root table covers the domain in nodes of 16^3
+     * bricks; each node maps its bricks to slots of an R16F 3D atlas, or to VOLUME_EMPTY.
+     * Bricks are 8^3 voxels stored with a one voxel apron, so the hardware trilinear filter
+     * works inside a slot and a lookup is two table reads plus one texture fetch.
+     *
+     * The host copy is authoritative: SetVoxel activates bricks, Prune deactivates the ones
+     * that returned to the background, and Flush streams dirty bricks and table words to the
+     * GPU under a per-call brick budget. A brick's table entry is only published together with
+     * its texels, so shaders never see a slot before its data.
+     *
+     * The atlas is a stack of layers of slots. It starts with one layer and doubles its layer
+     * count when the free slots run out, up to maxBricks, so device memory follows the active
+     * brick count. Growing keeps slot coordinates (x and y stay fixed) and happens in the next
+     * Flush, which copies the old layers across. The atlas never shrinks: pruned slots are reused.
+     */
+    class SparseVolume {
+    public:
+        SparseVolume(Primitives& primitives, const SparseVolumeInput& input, bool debug)
+            : primitives(primitives), device(primitives.Device()), input(input), debug(debug) {
+            if (debug) std::cout << "making sparse volume of " << input.maxBricks << " bricks" << "\n";
+
+            for (int axis = 0; axis < 3; axis++){
+                if (input.rootDims[axis] <= 0) throw std::invalid_argument("sparse volume needs a non-empty root table");
+            }
+            rootTable.assign(static_cast<size_t>(input.rootDims[0]) * input.rootDims[1] * input.rootDims[2], volumeEmpty);
+            nodePool.assign(static_cast<size_t>(input.maxNodes) * nodeBricks, volumeEmpty);
+            nodeActiveBricks.assign(input.maxNodes, 0);
+            for (uint32_t slot = input.maxNodes; slot > 0; slot--) freeNodes.push_back(slot - 1);
+
+            MakeAtlas();
+            MakeDescriptors();
+            samplePipeline = primitives.MakePipeline("volume_sample", sizeof(VolumeSampleParams), {}, {descriptorSetLayout});
+
+            rootBuffer = primitives.MakeBuffer(rootTable.size() * sizeof(uint32_t), false);
+            nodeBuffer = primitives.MakeBuffer(nodePool.size() * sizeof(uint32_t), false);
+            infoBuffer = primitives.MakeBuffer(sizeof(VolumeInfo), false);
+
+            VolumeInfo info = Info();
+            primitives.Upload(infoBuffer, &info, sizeof(info));
+
+            primitives.Submit([&](vk::CommandBuffer cmd) {
+                cmd.fillBuffer(rootBuffer.buffer, 0, VK_WHOLE_SIZE, volumeEmpty);
+                cmd.fillBuffer(nodeBuffer.buffer, 0, VK_WHOLE_SIZE, volumeEmpty);
+                TransitionImage(cmd, atlas.image, vk::ImageLayout::eUndefined, vk::ImageLayout::eShaderReadOnlyOptimal);
+            });
+        }
+
+        ~SparseVolume() {
+            device.waitIdle();
+            for (vkUtil::Buffer* buffer : {&rootBuffer, &nodeBuffer, &infoBuffer, &staging}){
+                if (buffer->buffer) primitives.DestroyBuffer(*buffer);
+            }
+            primitives.DestroyPipeline(samplePipeline);
+            device.destroyDescriptorPool(descriptorPool);
+            device.destroyDescriptorSetLayout(descriptorSetLayout);
+            device.destroySampler(sampler);
+            DestroyAtlas(retiredAtlas);
+            DestroyAtlas(atlas);
+        }
+
+        SparseVolume(const SparseVolume&) = delete;
+        SparseVolume& operator=(const SparseVolume&) = delete;
+
+        // writes one voxel, activating its brick; background writes to inactive bricks are dropped
+        void SetVoxel(int32_t x, int32_t y, int32_t z, float value) {
+            std::array<int32_t, 3> voxel = {x, y, z};
+            std::array<int32_t, 3> brick = BrickOf(voxel);
+            if (!InDomain(brick)) throw std::out_of_range("voxel outside the sparse volume domain");
+
+            auto found = bricks.find(BrickKey(brick));
+            if (found == bricks.end()){
+                if (value == input.background) return;
+                found = Activate(brick);
+            }
+
+            std::array<int32_t, 3> local = {x - brick[0] * brickSize, y - brick[1] * brickSize, z - brick[2] * brickSize};
+            float& stored = found->second.values[local[0] + brickSize * (local[1] + brickSize * local[2])];
+            if (stored == value) return;
+            stored = value;
+            dirtyBricks.insert(found->first);
+            MarkNeighborsDirty(brick, &local);
+        }
+
+        float GetVoxel(int32_t x, int32_t y, int32_t z) const {
+            std::array<int32_t, 3> brick = BrickOf({x, y, z});
+            if (!InDomain(brick)) return input.background;
+            auto found = bricks.find(BrickKey(brick));
+            if (found == bricks.end()) return input.background;
+            return found->second.values[(x - brick[0] * brickSize) + brickSize * ((y - brick[1] * brickSize) + brickSize * (z - brick[2] * brickSize))];
+        }
+
+        // deactivates every brick whose voxels all lie within tolerance of the background; returns how many
+        uint32_t Prune(float tolerance) {
+            std::vector<std::array<int32_t, 3>> inactive;
+            for (const auto& [key, brick] : bricks){
+                bool empty = std::all_of(brick.values.begin(), brick.values.end(), [&](float value) {
+                    return std::abs(value - input.background) <= tolerance;
+                });
+                if (empty) inactive.push_back(brick.coordinate);
+            }
+            for (const std::array<int32_t, 3>& brick : inactive) Deactivate(brick);
+            return static_cast<uint32_t>(inactive.size());
+        }
+
+        void Deactivate(const std::array<int32_t, 3>& brick) {
+            auto found = bricks.find(BrickKey(brick));
+            if (found == bricks.end()) return;
+
+            uint32_t rootIndex = RootIndex(brick);
+            uint32_t node = rootTable[rootIndex];
+            SetTableWord(nodePool, dirtyNodeWords, node * nodeBricks + LocalIndex(brick), volumeEmpty);
+            if (--nodeActiveBricks[node] == 0){
+                SetTableWord(rootTable, dirtyRootWords, rootIndex, volumeEmpty);
+                freeNodes.push_back(node);
+            }
+
+            freeSlots.push_back(found->second.slot);
+            dirtyBricks.erase(found->first);
+            bricks.erase(found);
+            MarkNeighborsDirty(brick, nullptr);
+        }
+
+        /*
+         * Records uploads of up to brickBudget dirty bricks plus every pending table change and
+         * returns how many bricks are still waiting. The staging memory is reused on the next
+         * call, so the previous Flush must have finished executing before calling it again.
+         * A Flush that grows the atlas waits for the device first.
+         */
+        uint32_t Flush(vk::CommandBuffer cmd, uint32_t brickBudget = std::numeric_limits<uint32_t>::max()) {
+            // the Flush that replaced it has finished, so nothing reads the old atlas any more
+            DestroyAtlas(retiredAtlas);
+            if (atlasLayersWanted > atlasBricks[2]) GrowAtlas(cmd);
+
+            // scratch lists are members, so a streaming frame reuses their storage instead of allocating
+            flushUploads.clear();
+            for (uint64_t key : dirtyBricks){
+                if (flushUploads.size() >= brickBudget) break;
+                flushUploads.push_back(key);
+            }
+            for (uint64_t key : flushUploads){
+                dirtyBricks.erase(key);
+                const Brick& brick = bricks.at(key);
+                SetTableWord(nodePool, dirtyNodeWords, rootTable[RootIndex(brick.coordinate)] * nodeBricks + LocalIndex(brick.coordinate), brick.slot);
+            }
+            if (flushUploads.empty() && dirtyRootWords.empty() && dirtyNodeWords.empty()) return 0;
+            for (std::vector<uint32_t>* dirty : {&dirtyRootWords, &dirtyNodeWords}){
+                std::sort(dirty->begin(), dirty->end());
+                dirty->erase(std::unique(dirty->begin(), dirty->end()), dirty->end());
+            }
+
+            constexpr vk::DeviceSize brickBytes = brickStored * brickStored * brickStored * sizeof(uint16_t);
+            vk::DeviceSize tableOffset = flushUploads.size() * brickBytes;
+            vk::DeviceSize size = tableOffset + (dirtyRootWords.size() + dirtyNodeWords.size()) * sizeof(uint32_t);
+            ReserveStaging(size);
+
+            brickCopies.clear();
+            auto* texels = static_cast<uint16_t*>(staging.mapped);
+            for (size_t i = 0; i < flushUploads.size(); i++){
+                const Brick& brick = bricks.at(flushUploads[i]);
+                WriteStoredBrick(brick.coordinate, texels + i * brickBytes / sizeof(uint16_t));
+
+                std::array<int32_t, 3> slot = SlotCoordinate(brick.slot);
+                brickCopies.emplace_back(
+                        i * brickBytes, 0, 0,
+                        vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1),
+                        vk::Offset3D(slot[0] * brickStored, slot[1] * brickStored, slot[2] * brickStored),
+                        vk::Extent3D(brickStored, brickStored, brickStored)
+                );
+            }
+
+            auto* words = reinterpret_cast<uint32_t*>(static_cast<std::byte*>(staging.mapped) + tableOffset);
+            rootCopies.clear();
+            nodeCopies.clear();
+            vk::DeviceSize offset = tableOffset;
+            for (uint32_t index : dirtyRootWords){
+                *words++ = rootTable[index];
+                rootCopies.emplace_back(offset, index * sizeof(uint32_t), sizeof(uint32_t));
+                offset += sizeof(uint32_t);
+            }
+            for (uint32_t index : dirtyNodeWords){
+                *words++ = nodePool[index];
+                nodeCopies.emplace_back(offset, index * sizeof(uint32_t), sizeof(uint32_t));
+                offset += sizeof(uint32_t);
+            }
+            dirtyRootWords.clear();
+            dirtyNodeWords.clear();
+
+            // earlier frames may still sample slots that are about to be overwritten
+            vk::MemoryBarrier readBarrier = vk::MemoryBarrier(vk::AccessFlagBits::eShaderRead, vk::AccessFlagBits::eTransferWrite);
+            cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eFragmentShader,
+                                vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(), readBarrier, nullptr, nullptr);
+
+            if (!brickCopies.empty()){
+                TransitionImage(cmd, atlas.image, vk::ImageLayout::eShaderReadOnlyOptimal, vk::ImageLayout::eTransferDstOptimal);
+                cmd.copyBufferToImage(staging.buffer, atlas.image, vk::ImageLayout::eTransferDstOptimal, brickCopies);
+                TransitionImage(cmd, atlas.image, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal);
+            }
+            if (!rootCopies.empty()) cmd.copyBuffer(staging.buffer, rootBuffer.buffer, rootCopies);
+            if (!nodeCopies.empty()) cmd.copyBuffer(staging.buffer, nodeBuffer.buffer, nodeCopies);
+
+            vk::MemoryBarrier writeBarrier = vk::MemoryBarrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead);
+            cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eFragmentShader,
+                                vk::DependencyFlags(), writeBarrier, nullptr, nullptr);
+
+            primitives.Metrics().uploadBytes->Add(size);
+            return static_cast<uint32_t>(dirtyBricks.size());
+        }
+
+        // result receives one float per vec4 point (xyz in world space)
+        void Sample(vk::CommandBuffer cmd, vk::DeviceAddress points, vk::DeviceAddress result, uint32_t count) {
+            if (count == 0) return;
+            Primitives::Barrier(cmd);
+
+            VolumeSampleParams params{infoBuffer.address, points, result, count, 0};
+            cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, samplePipeline.layout, 0, descriptorSet, nullptr);
+            Primitives::Dispatch(cmd, samplePipeline, &params, sizeof(params), (count + workgroupSize - 1) / workgroupSize);
+        }
+
+        // CPU counterpart of SampleVolume in sparse_volume.glsl, for validation
+        float SampleCpu(const float world[3]) const {
+            std::array<float, 3> p;
+            std::array<int32_t, 3> brick;
+            for (int axis = 0; axis < 3; axis++){
+                p[axis] = (world[axis] - input.origin[axis]) / input.voxelSize;
+                brick[axis] = static_cast<int32_t>(std::floor(p[axis] / brickSize));
+            }
+            if (!InDomain(brick) || bricks.find(BrickKey(brick)) == bricks.end()) return input.background;
+
+            std::array<int32_t, 3> base;
+            std::array<float, 3> weight;
+            for (int axis = 0; axis < 3; axis++){
+                float shifted = p[axis] - 0.5f;
+                base[axis] = static_cast<int32_t>(std::floor(shifted));
+                weight[axis] = shifted - base[axis];
+            }
+
+            float result = 0.0f;
+            for (int corner = 0; corner < 8; corner++){
+                int dx = corner & 1, dy = (corner >> 1) & 1, dz = corner >> 2;
+                float w = (dx ? weight[0] : 1.0f - weight[0]) * (dy ? weight[1] : 1.0f - weight[1]) * (dz ? weight[2] : 1.0f - weight[2]);
+                result += w * GetVoxel(base[0] + dx, base[1] + dy, base[2] + dz);
+            }
+            return result;
+        }
+
+        uint32_t ActiveBricks() const { return static_cast<uint32_t>(bricks.size()); }
+        uint32_t PendingBricks() const { return static_cast<uint32_t>(dirtyBricks.size()); }
+        // true while the next Flush has anything to record, bricks or table words
+        bool HasPendingChanges() const {
+            return !dirtyBricks.empty() || !dirtyRootWords.empty() || !dirtyNodeWords.empty() || atlasLayersWanted > atlasBricks[2];
+        }
+
+        // device memory allocated: the atlas layers grown so far plus the tables
+        vk::DeviceSize AllocatedBytes() const {
+            return atlas.size + rootBuffer.allocationSize + nodeBuffer.allocationSize + infoBuffer.allocationSize;
+        }
+
+        // host-visible upload memory, grown to the largest Flush so far
+        vk::DeviceSize StagingBytes() const { return staging.buffer ? staging.allocationSize : 0; }
+
+        // the part of AllocatedBytes the active field occupies: atlas slots, node tables and the root table
+        vk::DeviceSize ActiveBytes() const {
+            vk::DeviceSize nodes = input.maxNodes - freeNodes.size();
+            return bricks.size() * brickStored * brickStored * brickStored * sizeof(uint16_t)
+                   + nodes * nodeBricks * sizeof(uint32_t) + rootTable.size() * sizeof(uint32_t);
+        }
+
+        vk::DeviceAddress InfoAddress() const { return infoBuffer.address; }
+        vk::DescriptorSetLayout DescriptorSetLayout() const { return descriptorSetLayout; }
+        vk::DescriptorSet DescriptorSet() const { return descriptorSet; }
+
+    private:
+        struct Brick {
+            std::array<int32_t, 3> coordinate;
+            uint32_t slot;
+            std::array<float, brickSize * brickSize * brickSize> values;
+        };
+
+        Primitives& primitives;
+        vk::Device device;
+        SparseVolumeInput input;
+        bool debug;
+
+        // host copy; slotCapacity slots have been handed to freeSlots, atlasLayersWanted layers hold them
+        std::unordered_map<uint64_t, Brick> bricks;
+        std::unordered_set<uint64_t> dirtyBricks;
+        std::vector<uint32_t> rootTable, nodePool, nodeActiveBricks;
+        std::vector<uint32_t> freeSlots, freeNodes;
+        std::vector<uint32_t> dirtyRootWords, dirtyNodeWords;
+        uint32_t slotCapacity{0};
+        int32_t atlasLayersWanted{1};
+
+        // Flush scratch, kept between calls
+        std::vector<uint64_t> flushUploads;
+        std::vector<vk::BufferImageCopy> brickCopies;
+        std::vector<vk::BufferCopy> rootCopies, nodeCopies;
+
+        // device copy; retiredAtlas is the one a growing Flush copied from, freed by the next Flush
+        int32_t atlasBricks[3]{};
+        int32_t maxAtlasLayers{1};
+        vkUtil::Image atlas, retiredAtlas;
+        vk::Sampler sampler{nullptr};
+        vk::DescriptorSetLayout descriptorSetLayout{nullptr};
+        vk::DescriptorPool descriptorPool{nullptr};
+        vk::DescriptorSet descriptorSet{nullptr};
+        vkUtil::Buffer rootBuffer, nodeBuffer, infoBuffer, staging;
+        vkInit::ComputePipelineOutBundle samplePipeline;
+
+        static std::array<int32_t, 3> BrickOf(const std::array<int32_t, 3>& voxel) {
+            // floor division, so negative voxels land in negative bricks
+            std::array<int32_t, 3> brick;
+            for (int axis = 0; axis < 3; axis++) brick[axis] = voxel[axis] >= 0 ? voxel[axis] / brickSize : -((-voxel[axis] + brickSize - 1) / brickSize);
+            return brick;
+        }
+
+        bool InDomain(const std::array<int32_t, 3>& brick) const {
+            for (int axis = 0; axis < 3; axis++){
+                if (brick[axis] < 0 || brick[axis] >= input.rootDims[axis] * nodeBricksPerAxis) return false;
+            }
+            return true;
+        }
+
+        uint64_t BrickKey(const std::array<int32_t, 3>& brick) const {
+            uint64_t dimX = static_cast<uint64_t>(input.rootDims[0]) * nodeBricksPerAxis;
+            uint64_t dimY = static_cast<uint64_t>(input.rootDims[1]) * nodeBricksPerAxis;
+            return brick[0] + dimX * (brick[1] + dimY * brick[2]);
+        }
+
+        uint32_t RootIndex(const std::array<int32_t, 3>& brick) const {
+            int32_t x = brick[0] / nodeBricksPerAxis, y = brick[1] / nodeBricksPerAxis, z = brick[2] / nodeBricksPerAxis;
+            return static_cast<uint32_t>(x + input.rootDims[0] * (y + input.rootDims[1] * z));
+        }
+
+        static uint32_t LocalIndex(const std::array<int32_t, 3>& brick) {
+            int32_t mask = nodeBricksPerAxis - 1;
+            return static_cast<uint32_t>((brick[0] & mask) + nodeBricksPerAxis * ((brick[1] & mask) + nodeBricksPerAxis * (brick[2] & mask)));
+        }
+
+        std::array<int32_t, 3> SlotCoordinate(uint32_t slot) const {
+            int32_t s = static_cast<int32_t>(slot);
+            return {s % atlasBricks[0], (s / atlasBricks[0]) % atlasBricks[1], s / (atlasBricks[0] * atlasBricks[1])};
+        }
+
+        static void SetTableWord(std::vector<uint32_t>& table, std::vector<uint32_t>& dirty, uint32_t index, uint32_t value) {
+            if (table[index] == value) return;
+            table[index] = value;
+            dirty.push_back(index);
+        }
+
+        std::unordered_map<uint64_t, Brick>::iterator Activate(const std::array<int32_t, 3>& brick) {
+            if (freeSlots.empty()) AddSlots();
+
+            uint32_t rootIndex = RootIndex(brick);
+            if (rootTable[rootIndex] == volumeEmpty){
+                if (freeNodes.empty()) throw std::length_error("sparse volume node pool is full");
+                SetTableWord(rootTable, dirtyRootWords, rootIndex, freeNodes.back());
+                freeNodes.pop_back();
+            }
+            nodeActiveBricks[rootTable[rootIndex]]++;
+
+            Brick created{brick, freeSlots.back(), {}};
+            freeSlots.pop_back();
+            created.values.fill(input.background);
+            return bricks.emplace(BrickKey(brick), created).first;
+        }
+
+        // local == nullptr marks all 26 neighbours, otherwise only those whose apron holds that voxel
+        void MarkNeighborsDirty(const std::array<int32_t, 3>& brick, const std::array<int32_t, 3>* local) {
+            for (int dz = -1; dz <= 1; dz++) for (int dy = -1; dy <= 1; dy++) for (int dx = -1; dx <= 1; dx++){
+                std::array<int32_t, 3> offset = {dx, dy, dz};
+                if (dx == 0 && dy == 0 && dz == 0) continue;
+
+                bool touches = true;
+                for (int axis = 0; local && axis < 3; axis++){
+                    if (offset[axis] == -1 && (*local)[axis] != 0) touches = false;
+                    if (offset[axis] == 1 && (*local)[axis] != brickSize - 1) touches = false;
+                }
+                std::array<int32_t, 3> neighbor = {brick[0] + dx, brick[1] + dy, brick[2] + dz};
+                if (!touches || !InDomain(neighbor)) continue;
+
+                uint64_t key = BrickKey(neighbor);
+                if (bricks.count(key)) dirtyBricks.insert(key);
+            }
+        }
+
+        // 10^3 half texels: the brick's voxels plus a one voxel apron from its neighbours
+        void WriteStoredBrick(const std::array<int32_t, 3>& brick, uint16_t* texels) const {
+            const Brick* neighbors[27];
+            for (int i = 0; i < 27; i++){
+                std::array<int32_t, 3> neighbor = {brick[0] + i % 3 - 1, brick[1] + (i / 3) % 3 - 1, brick[2] + i / 9 - 1};
+                auto found = InDomain(neighbor) ? bricks.find(BrickKey(neighbor)) : bricks.end();
+                neighbors[i] = found == bricks.end() ? nullptr : &found->second;
+            }
+
+            for (int32_t z = 0; z < brickStored; z++) for (int32_t y = 0; y < brickStored; y++) for (int32_t x = 0; x < brickStored; x++){
+                std::array<int32_t, 3> stored = {x - 1, y - 1, z - 1};
+                int neighbor = 0, stride = 1;
+                std::array<int32_t, 3> local;
+                for (int axis = 0; axis < 3; axis++){
+                    int side = stored[axis] < 0 ? 0 : (stored[axis] >= brickSize ? 2 : 1);
+                    neighbor += side * stride;
+                    stride *= 3;
+                    local[axis] = stored[axis] - (side - 1) * brickSize;
+                }
+                const Brick* source = neighbors[neighbor];
+                float value = source ? source->values[local[0] + brickSize * (local[1] + brickSize * local[2])] : input.background;
+                texels[x + brickStored * (y + brickStored * z)] = FloatToHalf(value);
+            }
+        }
+
+        VolumeInfo Info() const {
+            return VolumeInfo{{input.rootDims[0], input.rootDims[1], input.rootDims[2]}, input.voxelSize,
+                              {input.origin[0], input.origin[1], input.origin[2]}, input.background,
+                              {atlasBricks[0], atlasBricks[1], atlasBricks[2]}, 0,
+                              rootBuffer.address, nodeBuffer.address};
+        }
+
+        // fixes the layer footprint for maxBricks and makes the first layer
+        void MakeAtlas() {
+            vk::PhysicalDeviceProperties properties = primitives.PhysicalDevice().getProperties();
+            int32_t limit = static_cast<int32_t>(properties.limits.maxImageDimension3D / brickStored);
+
+            int32_t side = 1;
+            while (static_cast<uint64_t>(side) * side * side < input.maxBricks) side++;
+            atlasBricks[0] = std::min(side, limit);
+            atlasBricks[1] = std::min(side, limit);
+            maxAtlasLayers = static_cast<int32_t>((input.maxBricks + atlasBricks[0] * atlasBricks[1] - 1) / (atlasBricks[0] * atlasBricks[1]));
+            if (maxAtlasLayers > limit || input.maxBricks == 0) throw std::invalid_argument("sparse volume atlas does not fit a 3D image");
+
+            atlasLayersWanted = 1;
+            atlasBricks[2] = 1;
+            atlas = MakeAtlasImage(1);
+            AddSlots();
+
+            vk::SamplerCreateInfo samplerInfo = vk::SamplerCreateInfo();
+            samplerInfo.magFilter = vk::Filter::eLinear;
+            samplerInfo.minFilter = vk::Filter::eLinear;
+            samplerInfo.mipmapMode = vk::SamplerMipmapMode::eNearest;
+            samplerInfo.addressModeU = vk::SamplerAddressMode::eClampToEdge;
+            samplerInfo.addressModeV = vk::SamplerAddressMode::eClampToEdge;
+            samplerInfo.addressModeW = vk::SamplerAddressMode::eClampToEdge;
+            sampler = device.createSampler(samplerInfo);
+        }
+
+        vkUtil::Image MakeAtlasImage(int32_t layers) {
+            vkUtil::ImageInput imageInput;
+            imageInput.type = vk::ImageType::e3D;
+            imageInput.extent = vk::Extent3D(atlasBricks[0] * brickStored, atlasBricks[1] * brickStored, layers * brickStored);
+            imageInput.format = vk::Format::eR16Sfloat;
+            imageInput.usage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eTransferSrc;
+            imageInput.physicalDevice = primitives.PhysicalDevice();
+            imageInput.device = device;
+            vkUtil::Image image = vkUtil::CreateImage(imageInput);
+            primitives.Metrics().allocatedDeviceBytes->Add(static_cast<int64_t>(image.size));
+            return image;
+        }
+
+        void DestroyAtlas(vkUtil::Image& image) {
+            if (!image.image) return;
+            primitives.Metrics().allocatedDeviceBytes->Add(-static_cast<int64_t>(image.size));
+            vkUtil::DestroyImage(device, image);
+        }
+
+        // hands out the slots of the layers the atlas grows to next; the device side follows in Flush
+        void AddSlots() {
+            if (slotCapacity >= input.maxBricks) throw std::length_error("sparse volume atlas is full");
+            uint32_t layerSlots = static_cast<uint32_t>(atlasBricks[0] * atlasBricks[1]);
+            if (slotCapacity > 0) atlasLayersWanted = std::min(atlasLayersWanted * 2, maxAtlasLayers);
+
+            uint32_t capacity = std::min(static_cast<uint32_t>(atlasLayersWanted) * layerSlots, input.maxBricks);
+            for (uint32_t slot = capacity; slot > slotCapacity; slot--) freeSlots.push_back(slot - 1);
+            slotCapacity = capacity;
+        }
+
+        /*
+         * Copies the atlas into one with atlasLayersWanted layers and points the descriptor set
+         * and VolumeInfo at it. Work recorded since the last Flush may still sample through the
+         * descriptor set, so this waits for the device; it happens once per doubling.
+         */
+        void GrowAtlas(vk::CommandBuffer cmd) {
+            device.waitIdle();
+            vkUtil::Image grown = MakeAtlasImage(atlasLayersWanted);
+
+            TransitionImage(cmd, atlas.image, vk::ImageLayout::eShaderReadOnlyOptimal, vk::ImageLayout::eTransferSrcOptimal);
+            TransitionImage(cmd, grown.image, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal);
+            vk::ImageSubresourceLayers layers = vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1);
+            vk::Extent3D extent = vk::Extent3D(atlasBricks[0] * brickStored, atlasBricks[1] * brickStored, atlasBricks[2] * brickStored);
+            cmd.copyImage(atlas.image, vk::ImageLayout::eTransferSrcOptimal, grown.image, vk::ImageLayout::eTransferDstOptimal,
+                          vk::ImageCopy(layers, vk::Offset3D(0, 0, 0), layers, vk::Offset3D(0, 0, 0), extent));
+            TransitionImage(cmd, grown.image, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal);
+
+            retiredAtlas = atlas;
+            atlas = grown;
+            atlasBricks[2] = atlasLayersWanted;
+            WriteAtlasDescriptor();
+
+            VolumeInfo info = Info();
+            cmd.updateBuffer(infoBuffer.buffer, 0, sizeof(info), &info);
+            vk::MemoryBarrier infoBarrier = vk::MemoryBarrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead);
+            cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eFragmentShader,
+                                vk::DependencyFlags(), infoBarrier, nullptr, nullptr);
+            if (debug) std::cout << "sparse volume atlas grew to " << atlasBricks[2] << " of " << maxAtlasLayers << " layers" << "\n";
+        }
+
+        void MakeDescriptors() {
+            vkInit::DescriptorSetLayoutData bindings;
+            bindings.indices.push_back(0);
+            bindings.types.push_back(vk::DescriptorType::eCombinedImageSampler);
+            bindings.counts.push_back(1);
+            bindings.stages.push_back(vk::ShaderStageFlagBits::eCompute | vk::ShaderStageFlagBits::eFragment);
+
+            descriptorSetLayout = vkInit::MakeDescriptorSetLayout(device, bindings, debug);
+            descriptorPool = vkInit::MakeDescriptorPool(device, 1, bindings, debug);
+            descriptorSet = vkInit::AllocateDescriptorSet(device, descriptorPool, descriptorSetLayout, debug);
+            WriteAtlasDescriptor();
+        }
+
+        void WriteAtlasDescriptor() {
+            vk::DescriptorImageInfo imageInfo = vk::DescriptorImageInfo(sampler, atlas.view, vk::ImageLayout::eShaderReadOnlyOptimal);
+            vk::WriteDescriptorSet write = vk::WriteDescriptorSet(descriptorSet, 0, 0, vk::DescriptorType::eCombinedImageSampler, imageInfo);
+            device.updateDescriptorSets(write, nullptr);
+        }
+
+        void ReserveStaging(vk::DeviceSize size) {
+            if (staging.buffer && staging.size >= size) return;
+            if (staging.buffer) primitives.DestroyBuffer(staging);
+            staging = primitives.MakeBuffer(size + size / 2, true);
+        }
+
+        void TransitionImage(vk::CommandBuffer cmd, vk::Image image, vk::ImageLayout from, vk::ImageLayout to) {
+            vk::PipelineStageFlags shaders = vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eFragmentShader;
+            auto access = [](vk::ImageLayout layout) {
+                if (layout == vk::ImageLayout::eShaderReadOnlyOptimal) return vk::AccessFlags(vk::AccessFlagBits::eShaderRead);
+                if (layout == vk::ImageLayout::eTransferDstOptimal) return vk::AccessFlags(vk::AccessFlagBits::eTransferWrite);
+                if (layout == vk::ImageLayout::eTransferSrcOptimal) return vk::AccessFlags(vk::AccessFlagBits::eTransferRead);
+                return vk::AccessFlags();
+            };
+            auto stages = [&](vk::ImageLayout layout) {
+                if (layout == vk::ImageLayout::eUndefined) return vk::PipelineStageFlags(vk::PipelineStageFlagBits::eTopOfPipe);
+                if (layout == vk::ImageLayout::eShaderReadOnlyOptimal) return shaders;
+                return vk::PipelineStageFlags(vk::PipelineStageFlagBits::eTransfer);
+            };
+
+            vk::ImageMemoryBarrier barrier = vk::ImageMemoryBarrier(
+                    access(from), access(to), from, to, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, image,
+                    vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1)
+            );
+            cmd.pipelineBarrier(stages(from), stages(to), vk::DependencyFlags(), nullptr, nullptr, barrier);
+        }
+    };
+}
@@ -0,0 +1,154 @@
+#pragma once
+#include "Primitives.h"
+
+namespace vkCompute {
+    struct GridCountParams {
+        GridParams grid;
+        vk::DeviceAddress positions, cellCount, cellOf, rank;
+        uint32_t count, padding;
+    };
+
+    struct GridReorderParams {
+        GridParams grid;
+        vk::DeviceAddress positions, attributes, cellStart, cellOf, rank, sortedPositions, sortedAttributes, sortedToOriginal;
+        uint32_t count, hasAttributes;
+    };
+
+    struct GridNeighborCountParams {
+        GridParams grid;
+        vk::DeviceAddress sortedPositions, cellStart, cellCount, sortedToOriginal, result;
+        float radius;
+        uint32_t count;
+    };
+
+    // what a simulation kernel needs to walk the grid, see shaders/compute/grid_common.glsl
+    struct GridView {
+        GridParams grid;
+        vk::DeviceAddress sortedPositions, sortedAttributes, sortedToOriginal, cellStart, cellCount;
+    };
+
+    /*
+     * Particle grid rebuilt from scratch every step with a counting sort: bin particles and rank
+     * them within their cell, scan the cell counts, scatter positions (plus one optional vec4
+     * attribute) into cell order. Build cost is linear in particles plus table size, and
+     * neighbour queries touch 27 cells instead of every particle.
+     *
+     * Positions are vec4 (xyz used). Neighbour queries are complete for radii up to the cell size.
+     */
+    class SpatialGrid {
+    public:
+        SpatialGrid(Primitives& primitives, bool debug) : primitives(primitives), debug(debug) {
+            if (debug) std::cout << "making spatial grid" << "\n";
+            countPipeline = primitives.MakePipeline("grid_count", sizeof(GridCountParams), {});
+            reorderPipeline = primitives.MakePipeline("grid_reorder", sizeof(GridReorderParams), {});
+            neighborCountPipeline = primitives.MakePipeline("grid_neighbor_count", sizeof(GridNeighborCountParams), {});
+        }
+
+        ~SpatialGrid() {
+            ReleaseBuffers();
+            primitives.DestroyPipeline(countPipeline);
+            primitives.DestroyPipeline(reorderPipeline);
+            primitives.DestroyPipeline(neighborCountPipeline);
+        }
+
+        SpatialGrid(const SpatialGrid&) = delete;
+        SpatialGrid& operator=(const SpatialGrid&) = delete;
+
+        // uniform grid of dims cells starting at origin; particles outside are clamped to the border cells
+        static GridParams UniformGrid(const float origin[3], float cellSize, const int32_t dims[3]) {
+            GridParams params{{origin[0], origin[1], origin[2]}, 1.0f / cellSize,
+                              {dims[0], dims[1], dims[2]},
+                              static_cast<uint32_t>(dims[0]) * static_cast<uint32_t>(dims[1]) * static_cast<uint32_t>(dims[2])};
+            return params;
+        }
+
+        // unbounded domain hashed into tableSize buckets; a table of about twice the particle count keeps collisions rare
+        static GridParams HashedGrid(float cellSize, uint32_t tableSize) {
+            GridParams params{{0.0f, 0.0f, 0.0f}, 1.0f / cellSize, {0, 0, 0}, tableSize};
+            return params;
+        }
+
+        // (re)allocates storage; only grows, attributes included, so call it with the largest expected sizes and not while a build is in flight
+        void Reserve(uint32_t maxParticles, uint32_t tableSize, bool withAttributes) {
+            withAttributes = withAttributes || sortedAttributes.buffer;
+            if (maxParticles <= particleCapacity && tableSize <= tableCapacity && (!withAttributes || sortedAttributes.buffer)) return;
+            ReleaseBuffers();
+
+            particleCapacity = std::max(maxParticles, particleCapacity);
+            tableCapacity = std::max(tableSize, tableCapacity);
+            vk::DeviceSize words = particleCapacity * sizeof(uint32_t);
+            vk::DeviceSize vectors = particleCapacity * 4 * sizeof(float);
+
+            cellCount = primitives.MakeBuffer(tableCapacity * sizeof(uint32_t), false);
+            cellStart = primitives.MakeBuffer(tableCapacity * sizeof(uint32_t), false);
+            cellOf = primitives.MakeBuffer(words, false);
+            rank = primitives.MakeBuffer(words, false);
+            sortedToOriginal = primitives.MakeBuffer(words, false);
+            sortedPositions = primitives.MakeBuffer(vectors, false);
+            if (withAttributes) sortedAttributes = primitives.MakeBuffer(vectors, false);
+
+            primitives.Reserve(tableCapacity);
+        }
+
+        // records a full rebuild; attributes may be 0
+        void Build(vk::CommandBuffer cmd, const GridParams& params, vk::DeviceAddress positions, vk::DeviceAddress attributes, uint32_t particleCount) {
+            if (particleCount > particleCapacity || params.tableSize > tableCapacity || (attributes && !sortedAttributes.buffer)){
+                throw std::length_error("spatial grid used beyond its reserved capacity");
+            }
+            grid = params;
+            particles = particleCount;
+            if (particleCount == 0) return;
+
+            Primitives::Barrier(cmd);
+            cmd.fillBuffer(cellCount.buffer, 0, params.tableSize * sizeof(uint32_t), 0);
+            Primitives::Barrier(cmd);
+
+            uint32_t workgroups = (particleCount + workgroupSize - 1) / workgroupSize;
+            GridCountParams countParams{params, positions, cellCount.address, cellOf.address, rank.address, particleCount, 0};
+            Primitives::Dispatch(cmd, countPipeline, &countParams, sizeof(countParams), workgroups);
+
+            primitives.Scan(cmd, cellCount.address, cellStart.address, params.tableSize, false);
+            Primitives::Barrier(cmd);
+
+            GridReorderParams reorderParams{params, positions, attributes, cellStart.address, cellOf.address, rank.address,
+                                            sortedPositions.address, attributes ? sortedAttributes.address : 0,
+                                            sortedToOriginal.address, particleCount, attributes ? 1u : 0u};
+            Primitives::Dispatch(cmd, reorderPipeline, &reorderParams, sizeof(reorderParams), workgroups);
+        }
+
+        // result receives, per original particle index, the number of other particles within radius
+        void CountNeighbors(vk::CommandBuffer cmd, vk::DeviceAddress result, float radius) {
+            if (particles == 0) return;
+            Primitives::Barrier(cmd);
+
+            GridNeighborCountParams params{grid, sortedPositions.address, cellStart.address, cellCount.address,
+                                           sortedToOriginal.address, result, radius, particles};
+            Primitives::Dispatch(cmd, neighborCountPipeline, &params, sizeof(params), (particles + workgroupSize - 1) / workgroupSize);
+        }
+
+        GridView View() const {
+            return GridView{grid, sortedPositions.address, sortedAttributes.address, sortedToOriginal.address,
+                            cellStart.address, cellCount.address};
+        }
+
+        uint32_t ParticleCount() const { return particles; }
+
+    private:
+        Primitives& primitives;
+        bool debug;
+
+        vkInit::ComputePipelineOutBundle countPipeline, reorderPipeline, neighborCountPipeline;
+
+        vkUtil::Buffer cellCount, cellStart, cellOf, rank, sortedToOriginal, sortedPositions, sortedAttributes;
+        uint32_t particleCapacity{0}, tableCapacity{0};
+
+        GridParams grid{};
+        uint32_t particles{0};
+
+        void ReleaseBuffers() {
+            for (vkUtil::Buffer* buffer : {&cellCount, &cellStart, &cellOf, &rank, &sortedToOriginal, &sortedPositions, &sortedAttributes}){
+                if (buffer->buffer) primitives.DestroyBuffer(*buffer);
+            }
+        }
+    };
+}
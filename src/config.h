@@ -2,9 +2,12 @@
 #include <vulkan/vulkan.hpp>
 #include <GLFW/glfw3.h>
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <vector>
 #include <set>
 #include <string>
 #include <optional>
+#include <memory_resource>
 #include  <fstream>
\ No newline at end of file
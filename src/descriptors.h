@@ -0,0 +1,62 @@
+#pragma once
+#include "config.h"
+
+namespace vkInit {
+    struct DescriptorSetLayoutData {
+        std::vector<uint32_t> indices;
+        std::vector<vk::DescriptorType> types;
+        std::vector<uint32_t> counts;
+        std::vector<vk::ShaderStageFlags> stages;
+    };
+
+    vk::DescriptorSetLayout MakeDescriptorSetLayout(vk::Device device, const DescriptorSetLayoutData& bindings, bool debug){
+        std::vector<vk::DescriptorSetLayoutBinding> layoutBindings;
+        for (size_t i = 0; i < bindings.indices.size(); i++){
+            layoutBindings.emplace_back(bindings.indices[i], bindings.types[i], bindings.counts[i], bindings.stages[i]);
+        }
+
+        vk::DescriptorSetLayoutCreateInfo layoutInfo = vk::DescriptorSetLayoutCreateInfo(
+                vk::DescriptorSetLayoutCreateFlags(),
+                static_cast<uint32_t>(layoutBindings.size()), layoutBindings.data()
+        );
+
+        try{
+            return device.createDescriptorSetLayout(layoutInfo);
+        }catch(vk::SystemError err){
+            if (debug) std::cerr << "failed to create descriptor set layout: " << err.what() << "\n";
+        }
+        return nullptr;
+    }
+
+    // pool sized for setCount sets of the given layout
+    vk::DescriptorPool MakeDescriptorPool(vk::Device device, uint32_t setCount, const DescriptorSetLayoutData& bindings, bool debug){
+        std::vector<vk::DescriptorPoolSize> poolSizes;
+        for (size_t i = 0; i < bindings.types.size(); i++){
+            poolSizes.emplace_back(bindings.types[i], bindings.counts[i] * setCount);
+        }
+
+        vk::DescriptorPoolCreateInfo poolInfo = vk::DescriptorPoolCreateInfo(
+                vk::DescriptorPoolCreateFlags(),
+                setCount,
+                static_cast<uint32_t>(poolSizes.size()), poolSizes.data()
+        );
+
+        try{
+            return device.createDescriptorPool(poolInfo);
+        }catch(vk::SystemError err){
+            if (debug) std::cerr << "failed to create descriptor pool: " << err.what() << "\n";
+        }
+        return nullptr;
+    }
+
+    vk::DescriptorSet AllocateDescriptorSet(vk::Device device, vk::DescriptorPool pool, vk::DescriptorSetLayout layout, bool debug){
+        vk::DescriptorSetAllocateInfo allocInfo = vk::DescriptorSetAllocateInfo(pool, 1, &layout);
+
+        try{
+            return device.allocateDescriptorSets(allocInfo)[0];
+        }catch(vk::SystemError err){
+            if (debug) std::cerr << "failed to allocate descriptor set: " << err.what() << "\n";
+        }
+        return nullptr;
+    }
+}
@@ -1,20 +1,30 @@
 #pragma once
 #include "config.h"
+#include "instance.h"
 #include "vkUtil/QueueFamilies.h"
 
 namespace vkInit {
-    bool CheckDeviceExtensionSupport(const vk::PhysicalDevice& device, const std::vector<const char*>& requestedExtensions, bool debug){
-        std::set<std::string> requiredExtensions(requestedExtensions.begin(), requestedExtensions.end());
-
-        if (debug) std::cout << "device can support extensions:" << "\n";
-        for (vk::ExtensionProperties& extension : device.enumerateDeviceExtensionProperties()){
-            if (debug) std::cout << "\t\"" << extension.extensionName << "\"\n";
-            requiredExtensions.erase(extension.extensionName);
+    // memory backs the temporary property list
+    bool CheckDeviceExtensionSupport(const vk::PhysicalDevice& device, const std::vector<const char*>& requestedExtensions, bool debug,
+                                     std::pmr::memory_resource* memory = std::pmr::get_default_resource()){
+        std::pmr::polymorphic_allocator<vk::ExtensionProperties> allocator(memory);
+        std::pmr::vector<vk::ExtensionProperties> supportedExtensions = device.enumerateDeviceExtensionProperties(nullptr, allocator);
+
+        if (debug){
+            std::cout << "device can support extensions:" << "\n";
+            for (const vk::ExtensionProperties& extension : supportedExtensions) std::cout << "\t\"" << extension.extensionName << "\"\n";
+        }
+        for (const char* requested : requestedExtensions){
+            bool found = std::any_of(supportedExtensions.begin(), supportedExtensions.end(), [&](const vk::ExtensionProperties& extension) {
+                return strcmp(requested, extension.extensionName) == 0;
+            });
+            if (!found) return false;
         }
-        return requiredExtensions.empty();
+        return true;
     }
 
-    bool IsSuitable(const vk::PhysicalDevice& device, const bool debug) {
+    bool IsSuitable(const vk::PhysicalDevice& device, const bool debug,
+                    std::pmr::memory_resource* memory = std::pmr::get_default_resource()) {
         if (debug) std::cout << "checking if device is suitable" << "\n";
 
         const std::vector<const char *> requestedExtensions = {
@@ -26,7 +36,7 @@ namespace vkInit {
             for (const char *ext: requestedExtensions) std::cout << "\t\"" << ext << "\"\n";
         }
 
-        if (bool extensionSupported = CheckDeviceExtensionSupport(device, requestedExtensions, debug)){
+        if (bool extensionSupported = CheckDeviceExtensionSupport(device, requestedExtensions, debug, memory)){
             if (debug) std::cout << "device supports all requested extensions" << "\n";
         } else {
             if (debug) std::cerr << "device does not support all requested extensions" << "\n";
@@ -35,24 +45,99 @@ namespace vkInit {
         return true;
     }
 
-    vk::PhysicalDevice ChoosePhysicalDevice(vk::Instance& instance, bool debug){
+    vk::PhysicalDevice ChoosePhysicalDevice(vk::Instance& instance, bool debug,
+                                            std::pmr::memory_resource* memory = std::pmr::get_default_resource()){
         if (debug) std::cout<< "choosing physical device" << "\n";
 
-        std::vector<vk::PhysicalDevice> devices = instance.enumeratePhysicalDevices();
+        std::pmr::polymorphic_allocator<vk::PhysicalDevice> allocator(memory);
+        std::pmr::vector<vk::PhysicalDevice> devices = instance.enumeratePhysicalDevices(allocator);
 
         if (debug) std::cout << "There are " << devices.size() << " physical devices available on this system\n";
 
         for (vk::PhysicalDevice device : devices){
             //std::cout << "device name: " << device.getProperties().deviceName << "\n";
             if (debug) LogDeviceProperties(device);
-            if (IsSuitable(device, debug)) return device;
+            if (IsSuitable(device, debug, memory)) return device;
         }
 
         return nullptr;
     }
 
-    vk::Device CreateLogicalDevice(vk::PhysicalDevice physicalDevice, vk::SurfaceKHR surface, bool debug){
-        vkUtil::QueueFamilyIndices indices = vkUtil::FindQueueFamilies(physicalDevice, surface, debug);
+    // 1.2 features and entry points need both the instance and the device at 1.2
+    bool SupportsVulkan12(const vk::PhysicalDevice& device){
+        return std::min(InstanceApiVersion(), device.getProperties().apiVersion) >= VK_MAKE_API_VERSION(0, 1, 2, 0);
+    }
+
+    /*
+     * The compute primitives address buffers through device addresses, publish lookback state with
+     * 64 bit atomics and lean on subgroup operations; devices lacking any of it run without them.
+     */
+    bool SupportsComputePrimitives(const vk::PhysicalDevice& device, bool debug){
+        if (!SupportsVulkan12(device)){
+            if (debug) std::cout << "instance or device is older than Vulkan 1.2, compute primitives are disabled" << "\n";
+            return false;
+        }
+
+        auto features = device.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>();
+        const auto& vulkan12Features = features.get<vk::PhysicalDeviceVulkan12Features>();
+        auto properties = device.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceSubgroupProperties>();
+        const auto& subgroupProperties = properties.get<vk::PhysicalDeviceSubgroupProperties>();
+
+        vk::SubgroupFeatureFlags requiredOperations = vk::SubgroupFeatureFlagBits::eBasic
+                | vk::SubgroupFeatureFlagBits::eArithmetic
+                | vk::SubgroupFeatureFlagBits::eBallot
+                | vk::SubgroupFeatureFlagBits::eVote;
+
+        bool supported = features.get<vk::PhysicalDeviceFeatures2>().features.shaderInt64
+                && vulkan12Features.bufferDeviceAddress
+                && vulkan12Features.shaderBufferInt64Atomics
+                && (subgroupProperties.supportedStages & vk::ShaderStageFlagBits::eCompute)
+                && (subgroupProperties.supportedOperations & requiredOperations) == requiredOperations
+                && subgroupProperties.subgroupSize >= 8;
+
+        if (debug) std::cout << "device " << (supported ? "supports" : "does not support") << " the compute primitives" << "\n";
+        return supported;
+    }
+
+    // extensions behind vkInterop::Exporter; consumers enable the same set on their device
+    const std::vector<const char*> externalExportExtensions = {
+            VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME,
+            VK_KHR_EXTERNAL_SEMAPHORE_FD_EXTENSION_NAME
+    };
+
+    /*
+     * Exporting results to other processes needs fd handles for memory and semaphores plus
+     * timeline semaphores to number the exported steps. Optional like the compute primitives.
+     */
+    bool SupportsExternalExport(const vk::PhysicalDevice& device, bool debug,
+                                std::pmr::memory_resource* memory = std::pmr::get_default_resource()){
+#ifdef _WIN32
+        if (debug) std::cout << "external memory export needs POSIX file descriptors, export is disabled" << "\n";
+        return false;
+#else
+        if (!SupportsVulkan12(device)){
+            if (debug) std::cout << "instance or device is older than Vulkan 1.2, external export is disabled" << "\n";
+            return false;
+        }
+
+        auto features = device.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>();
+        vk::PhysicalDeviceExternalSemaphoreInfo semaphoreInfo = vk::PhysicalDeviceExternalSemaphoreInfo(vk::ExternalSemaphoreHandleTypeFlagBits::eOpaqueFd);
+        vk::SemaphoreTypeCreateInfo timelineInfo = vk::SemaphoreTypeCreateInfo(vk::SemaphoreType::eTimeline, 0);
+        semaphoreInfo.pNext = &timelineInfo;
+        vk::ExternalSemaphoreProperties semaphoreProperties = device.getExternalSemaphoreProperties(semaphoreInfo);
+
+        bool supported = CheckDeviceExtensionSupport(device, externalExportExtensions, false, memory)
+                && features.get<vk::PhysicalDeviceVulkan12Features>().timelineSemaphore
+                && (semaphoreProperties.externalSemaphoreFeatures & vk::ExternalSemaphoreFeatureFlagBits::eExportable);
+
+        if (debug) std::cout << "device " << (supported ? "supports" : "does not support") << " external export" << "\n";
+        return supported;
+#endif
+    }
+
+    vk::Device CreateLogicalDevice(vk::PhysicalDevice physicalDevice, vk::SurfaceKHR surface, bool debug,
+                                   std::pmr::memory_resource* memory = std::pmr::get_default_resource()){
+        vkUtil::QueueFamilyIndices indices = vkUtil::FindQueueFamilies(physicalDevice, surface, debug, memory);
         std::vector<uint32_t> uniqueIndices = {indices.graphicsFamily.value()};
         if (indices.graphicsFamily.value() != indices.presentFamily.value()){
             uniqueIndices.push_back(indices.presentFamily.value());
@@ -66,10 +151,27 @@ namespace vkInit {
         std::vector<const char*> deviceExtensions = {
                 VK_KHR_SWAPCHAIN_EXTENSION_NAME
         };
+        bool externalExport = SupportsExternalExport(physicalDevice, debug, memory);
+        if (externalExport){
+            deviceExtensions.insert(deviceExtensions.end(), externalExportExtensions.begin(), externalExportExtensions.end());
+        }
 
         vk::PhysicalDeviceFeatures deviceFeatures = vk::PhysicalDeviceFeatures();
         //deviceFeatures.samplerAnisotropy = true;
 
+        vk::PhysicalDeviceVulkan12Features vulkan12Features = vk::PhysicalDeviceVulkan12Features();
+        vk::PhysicalDeviceFeatures2 deviceFeatures2 = vk::PhysicalDeviceFeatures2();
+        bool computePrimitives = SupportsComputePrimitives(physicalDevice, debug);
+        if (computePrimitives){
+            deviceFeatures.shaderInt64 = true;
+            vulkan12Features.bufferDeviceAddress = true;
+            vulkan12Features.shaderBufferInt64Atomics = true;
+        }
+        if (externalExport) vulkan12Features.timelineSemaphore = true;
+        bool chainFeatures = computePrimitives || externalExport;
+        if (chainFeatures) deviceFeatures2.pNext = &vulkan12Features;
+        deviceFeatures2.features = deviceFeatures;
+
         std::vector <const char *> enabledLayers;
         if (debug) enabledLayers.push_back("VK_LAYER_KHRONOS_validation");
 
@@ -79,8 +181,10 @@ namespace vkInit {
                 queueCreateInfo.size() , queueCreateInfo.data(),
                 enabledLayers.size(), enabledLayers.data(),
                 deviceExtensions.size(), deviceExtensions.data(),
-                &deviceFeatures
+                chainFeatures ? nullptr : &deviceFeatures
                 );
+        // features beyond 1.0 can only be enabled through a VkPhysicalDeviceFeatures2 chain
+        if (chainFeatures) deviceInfo.pNext = &deviceFeatures2;
         try{
             vk::Device device = physicalDevice.createDevice(deviceInfo);
             if (debug) std::cout << "gpu has been successfully abstracted" << "\n";
@@ -92,8 +196,9 @@ namespace vkInit {
         return nullptr;
     }
 
-    std::array<vk::Queue,2> GetQueue(vk::PhysicalDevice physicalDevice, vk::Device device, vk::SurfaceKHR surface, bool debug){
-        vkUtil::QueueFamilyIndices indices = vkUtil::FindQueueFamilies(physicalDevice, surface, debug);
+    std::array<vk::Queue,2> GetQueue(vk::PhysicalDevice physicalDevice, vk::Device device, vk::SurfaceKHR surface, bool debug,
+                                     std::pmr::memory_resource* memory = std::pmr::get_default_resource()){
+        vkUtil::QueueFamilyIndices indices = vkUtil::FindQueueFamilies(physicalDevice, surface, debug, memory);
 
         return { {
                 device.getQueue(indices.graphicsFamily.value(), 0),
@@ -2,14 +2,61 @@
 #include "instance.h"
 #include "logging.h"
 #include "device.h"
+#include "pipeline.h"
+#include "framebuffer.h"
+#include "commands.h"
+#include "sync.h"
 #include "vkUtil/Swapchain.h"
+#include "compute/Primitives.h"
+#include "compute/SparseVolume.h"
+#include "compute/Benchmark.h"
+#include "interop/Exporter.h"
 
-Engine::Engine(bool debug) {
+#include <cstdlib>
+#include <new>
+
+/*
+ * Global allocations made by a thread while it is inside BeginFrame/EndFrame. This covers
+ * everything that bypasses the engine's memory resources (standard containers, strings, and
+ * arena spills, which reach the heap through operator new as well), so a steady-state frame
+ * is checked for any heap use, not only for the allocations routed through FrameMemory().
+ */
+namespace {
+    thread_local bool countingFrameAllocations{false};
+    thread_local uint64_t frameGlobalAllocations{0};
+
+    void* CountedAllocate(std::size_t size, std::size_t alignment){
+        if (countingFrameAllocations) frameGlobalAllocations++;
+        if (size == 0) size = 1;
+        void* p = alignment > alignof(std::max_align_t)
+                ? std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment)
+                : std::malloc(size);
+        if (!p) throw std::bad_alloc();
+        return p;
+    }
+}
+
+void* operator new(std::size_t size){ return CountedAllocate(size, alignof(std::max_align_t)); }
+void* operator new(std::size_t size, std::align_val_t alignment){ return CountedAllocate(size, static_cast<std::size_t>(alignment)); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+
+Engine::Engine(bool debug, const std::string& metricsEndpoint) {
     debugMode = debug;
     if (debugMode) std::cout << "making a graphics engine" << std::endl;
+    MakeMetrics(metricsEndpoint);
     BuildGlfwWindow();
     MakeInstance();
     MakeDevice();
+    MakeFrameResources();
+}
+
+void Engine::MakeMetrics(const std::string& endpoint) {
+    if (!endpoint.empty()) {
+        metricsExporter = std::make_unique<metrics::Exporter>(metricsRegistry, endpoint, std::chrono::milliseconds(1000), debugMode);
+    }
 }
 
 void Engine::BuildGlfwWindow() {
@@ -28,6 +75,7 @@ void Engine::BuildGlfwWindow() {
 }
 
 void Engine::MakeInstance(){
+    metrics::ScopedTimer timer(*engineMetrics.initStepTime);
     instance = vkInit::MakeInstance(debugMode, "MMEAS");
     dldi = vk::detail::DispatchLoaderDynamic(instance, vkGetInstanceProcAddr);
     if (debugMode) debugMessenger = vkInit::MakeDebugMessenger(instance, dldi);
@@ -41,22 +89,290 @@ void Engine::MakeInstance(){
 }
 
 void Engine::MakeDevice(){
-    physicalDevice = vkInit::ChoosePhysicalDevice(instance, debugMode);
-    device = vkInit::CreateLogicalDevice(physicalDevice, surface, debugMode);
-    std::array<vk::Queue,2> queues = vkInit::GetQueue(physicalDevice, device, surface, debugMode);
+    metrics::ScopedTimer timer(*engineMetrics.initStepTime);
+    // one-off setup temporaries, released here rather than left in the frame arena
+    std::pmr::monotonic_buffer_resource setupMemory(&heapResource);
+    physicalDevice = vkInit::ChoosePhysicalDevice(instance, debugMode, &setupMemory);
+    device = vkInit::CreateLogicalDevice(physicalDevice, surface, debugMode, &setupMemory);
+    dldi.init(device);
+    graphicsFamily = vkUtil::FindQueueFamilies(physicalDevice, surface, debugMode, &setupMemory).graphicsFamily.value();
+    std::array<vk::Queue,2> queues = vkInit::GetQueue(physicalDevice, device, surface, debugMode, &setupMemory);
     graphicsQueue = queues[0];
     presentQueue = queues[1];
-    vkInit::SwapChainBundle bundle = vkInit::CreateSwapchain(device, physicalDevice, surface, width, height, debugMode);
+    vkInit::SwapChainBundle bundle = vkInit::CreateSwapchain(device, physicalDevice, surface, width, height, debugMode, &setupMemory);
     swapchain = bundle.swapchain;
     swapchainFrames = bundle.frames;
     swapchainFormat = bundle.format;
     swapchainExtent = bundle.extent;
+    engineMetrics.swapchainImages->Set(static_cast<int64_t>(swapchainFrames.size()));
+}
+
+// the kernels load on first use, so runs that never need the primitives don't depend on their SPIR-V
+vkCompute::Primitives* Engine::ComputePrimitives(){
+    if (!primitives && vkInit::SupportsComputePrimitives(physicalDevice, debugMode)) MakeCompute();
+    return primitives.get();
+}
+
+void Engine::MakeCompute(){
+    primitives = std::make_unique<vkCompute::Primitives>(
+            physicalDevice, device, graphicsQueue, graphicsFamily, engineMetrics, debugMode
+    );
+}
+
+bool Engine::BenchmarkPrimitives(){
+    try{
+        vkCompute::Primitives* compute = ComputePrimitives();
+        if (!compute){
+            std::cerr << "compute primitives are not available on this device\n";
+            return false;
+        }
+        bool primitivesMatch = vkCompute::RunBenchmarks(*compute, debugMode);
+        bool gridMatches = vkCompute::RunGridBenchmarks(*compute, debugMode);
+        bool volumeMatches = vkCompute::RunVolumeBenchmarks(*compute, debugMode);
+        return primitivesMatch && gridMatches && volumeMatches;
+    }catch(const std::exception& err){
+        std::cerr << "compute primitives failed: " << err.what() << "\n";
+        return false;
+    }
+}
+
+vkCompute::SparseVolume& Engine::MakeVolume(const vkCompute::SparseVolumeInput& input){
+    vkCompute::Primitives* compute = ComputePrimitives();
+    if (!compute) throw std::runtime_error("sparse volumes need the compute primitives");
+
+    DestroyRaymarchPipeline();
+    volume.reset();
+    volumeFlushFence = nullptr;
+    volume = std::make_unique<vkCompute::SparseVolume>(*compute, input, debugMode);
+    MakeRaymarchPipeline();
+    return *volume;
+}
+
+std::array<float, 3> Engine::MakeVolumeDemo(){
+    vkCompute::SparseVolumeInput input{{0.0f, 0.0f, 0.0f}, 1.0f, {1, 1, 1}, 4096, 1, 0.0f};
+    vkCompute::SparseVolume& demo = MakeVolume(input);
+
+    // bricks stream in over the first frames through the per-frame budget
+    const float center = 64.0f, radius = 48.0f, thickness = 4.0f;
+    for (int32_t z = 0; z < 128; z++) for (int32_t y = 0; y < 128; y++) for (int32_t x = 0; x < 128; x++){
+        float dx = x + 0.5f - center, dy = y + 0.5f - center, dz = z + 0.5f - center;
+        float distance = std::abs(std::sqrt(dx * dx + dy * dy + dz * dz) - radius);
+        if (distance < thickness) demo.SetVoxel(x, y, z, 1.0f - distance / thickness);
+    }
+
+    std::array<float, 3> target = {center, center, center};
+    float eye[3] = {center, center, center - 3.0f * radius};
+    SetCamera(eye, target.data());
+    return target;
+}
+
+void Engine::SetCamera(const float eye[3], const float target[3], float verticalFov){
+    float aspect = static_cast<float>(swapchainExtent.width) / static_cast<float>(swapchainExtent.height);
+    vkCompute::CameraRayMatrix(eye, target, verticalFov, aspect, cameraRays);
+    std::copy(eye, eye + 3, cameraEye);
+}
+
+vkInterop::Exporter& Engine::MakeExporter(const std::string& name, uint32_t slotCount){
+    if (!vkInit::SupportsExternalExport(physicalDevice, debugMode)) throw std::runtime_error("external export is not available on this device");
+
+    frameExportResource.reset();
+    exporter.reset();
+    exporter = std::make_unique<vkInterop::Exporter>(
+            physicalDevice, device, dldi, graphicsFamily, name, slotCount, engineMetrics, debugMode
+    );
+    return *exporter;
+}
+
+void Engine::ExportFrames(const std::string& name){
+    vkInterop::Exporter& frames = MakeExporter(name);
+    uint32_t resource = frames.AddBuffer("frame", frameExportBytes, vk::BufferUsageFlagBits::eTransferDst, true);
+    frames.Start();
+    frameExportResource = resource;
+}
+
+void Engine::MakeRaymarchPipeline(){
+    vkInit::GraphicsPipelineInBundle specification;
+    specification.device = device;
+    specification.vertexFilepath = "shaders/raymarch_vertex.spv";
+    specification.fragmentFilepath = "shaders/raymarch_fragment.spv";
+    specification.swapchainExtent = swapchainExtent;
+    specification.renderpass = renderpass;
+    specification.pushConstantSize = sizeof(vkCompute::RaymarchParams);
+    specification.setLayouts = { volume->DescriptorSetLayout() };
+
+    vkInit::GraphicsPipelineOutBundle output = vkInit::MakeFullscreenPipeline(specification, debugMode);
+    raymarchLayout = output.layout;
+    raymarchPipeline = output.pipeline;
+    engineMetrics.pipelinesCreated->Add();
+}
+
+void Engine::DestroyRaymarchPipeline(){
+    if (!raymarchPipeline) return;
+    device.waitIdle();
+    device.destroyPipeline(raymarchPipeline);
+    device.destroyPipelineLayout(raymarchLayout);
+    raymarchPipeline = nullptr;
+}
+
+void Engine::MakeFrameResources(){
+    renderpass = vkInit::MakeRenderpass(device, swapchainFormat, debugMode);
+
+    vkInit::FramebufferInput framebufferInput;
+    framebufferInput.device = device;
+    framebufferInput.renderpass = renderpass;
+    framebufferInput.swapchainExtent = swapchainExtent;
+    vkInit::MakeFramebuffers(framebufferInput, swapchainFrames, debugMode);
+
+    commandPool = vkInit::MakeCommandPool(device, graphicsFamily, debugMode);
+    for (auto& frame : swapchainFrames){
+        frame.commandBuffer = vkInit::MakeCommandBuffer(device, commandPool, debugMode);
+        frame.inFlight = vkInit::MakeFence(device, debugMode);
+        frame.imageAvailable = vkInit::MakeSemaphore(device, debugMode);
+        frame.renderFinished = vkInit::MakeSemaphore(device, debugMode);
+    }
+    maxFramesInFlight = swapchainFrames.size();
+}
+
+void Engine::DestroyFrameResources(){
+    device.waitIdle();
+    for (auto& frame : swapchainFrames){
+        device.destroyFence(frame.inFlight);
+        device.destroySemaphore(frame.imageAvailable);
+        device.destroySemaphore(frame.renderFinished);
+        device.destroyFramebuffer(frame.framebuffer);
+    }
+    device.destroyCommandPool(commandPool);
+    device.destroyRenderPass(renderpass);
+}
+
+bool Engine::PollEvents(){
+    if (!window) return false;
+    glfwPollEvents();
+    return !glfwWindowShouldClose(window);
+}
+
+void Engine::BeginRenderpass(vk::CommandBuffer cmd, uint32_t imageIndex){
+    vk::ClearValue clearColor = vk::ClearColorValue(std::array<float, 4>{0.0f, 0.0f, 0.0f, 1.0f});
+    vk::RenderPassBeginInfo renderpassInfo = vk::RenderPassBeginInfo(
+            renderpass, swapchainFrames[imageIndex].framebuffer,
+            vk::Rect2D(vk::Offset2D(0, 0), swapchainExtent),
+            1, &clearColor
+    );
+    cmd.beginRenderPass(renderpassInfo, vk::SubpassContents::eInline);
+}
+
+void Engine::Render(){
+    BeginFrame();
+    vkUtil::SwapChainFrame& frame = swapchainFrames[frameNumber];
+    (void)device.waitForFences(frame.inFlight, VK_TRUE, UINT64_MAX);
+
+    uint32_t imageIndex{0};
+    try{
+        imageIndex = device.acquireNextImageKHR(swapchain, UINT64_MAX, frame.imageAvailable, nullptr).value;
+    }catch(vk::OutOfDateKHRError err){
+        // the window is not resizable, so this only happens while it is being torn down
+        EndFrame();
+        return;
+    }
+    device.resetFences(frame.inFlight);
+
+    vk::CommandBuffer cmd = frame.commandBuffer;
+    cmd.reset();
+    cmd.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+    if (volume && raymarchPipeline){
+        if (volume->HasPendingChanges()){
+            // Flush reuses its staging memory, so the frame that flushed last has to be finished
+            if (volumeFlushFence && volumeFlushFence != frame.inFlight){
+                (void)device.waitForFences(volumeFlushFence, VK_TRUE, UINT64_MAX);
+            }
+            volume->Flush(cmd, volumeBrickBudget);
+            volumeFlushFence = frame.inFlight;
+        }
+        RecordVolumeDraw(cmd, imageIndex, cameraRays, cameraEye);
+    } else {
+        BeginRenderpass(cmd, imageIndex);
+        cmd.endRenderPass();
+    }
+    // the step is skipped when consumers hold its slot; the next frame tries again
+    std::optional<uint32_t> exportSlot;
+    if (frameExportResource) exportSlot = exporter->BeginStep();
+    if (exportSlot){
+        exporter->RecordAcquire(cmd, *exportSlot);
+        cmd.fillBuffer(exporter->Buffer(*frameExportResource, *exportSlot).buffer, 0, VK_WHOLE_SIZE, static_cast<uint32_t>(frameCount));
+        exporter->RecordRelease(cmd, *exportSlot);
+    }
+    cmd.end();
+
+    vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+    vk::SubmitInfo submitInfo = vk::SubmitInfo(1, &frame.imageAvailable, &waitStage, 1, &cmd,
+                                               1, &swapchainFrames[imageIndex].renderFinished);
+    {
+        metrics::ScopedTimer timer(*engineMetrics.queueSubmitLatency);
+        graphicsQueue.submit(submitInfo, frame.inFlight);
+    }
+    if (exportSlot) exporter->Publish(graphicsQueue);
+
+    vk::PresentInfoKHR presentInfo = vk::PresentInfoKHR(1, &swapchainFrames[imageIndex].renderFinished, 1, &swapchain, &imageIndex);
+    try{
+        (void)presentQueue.presentKHR(presentInfo);
+    }catch(vk::OutOfDateKHRError err){
+        if (debugMode) std::cout << "swapchain is out of date" << "\n";
+    }
+
+    frameNumber = (frameNumber + 1) % maxFramesInFlight;
+    EndFrame();
+}
+
+void Engine::RecordVolumeDraw(vk::CommandBuffer cmd, uint32_t imageIndex, const float inverseViewProjection[16], const float eye[3],
+                              float stepScale, float densityScale){
+    if (!volume) return;
+
+    vkCompute::RaymarchParams params{};
+    std::copy(inverseViewProjection, inverseViewProjection + 16, params.inverseViewProjection);
+    std::copy(eye, eye + 3, params.eye);
+    params.volume = volume->InfoAddress();
+    params.stepScale = stepScale;
+    params.densityScale = densityScale;
+
+    BeginRenderpass(cmd, imageIndex);
+    cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, raymarchPipeline);
+    cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, raymarchLayout, 0, volume->DescriptorSet(), nullptr);
+    cmd.pushConstants(raymarchLayout, vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, 0, sizeof(params), &params);
+    cmd.draw(3, 1, 0, 0);
+    cmd.endRenderPass();
+}
+
+void Engine::BeginFrame(){
+    frameArena.Reset();
+    frameStartHeapAllocations = frameGlobalAllocations;
+    countingFrameAllocations = true;
+    frameStart = std::chrono::steady_clock::now();
+}
+
+void Engine::EndFrame(){
+    countingFrameAllocations = false;
+    lastFrameHeapAllocations = frameGlobalAllocations - frameStartHeapAllocations;
+    engineMetrics.frameHeapAllocations->Add(lastFrameHeapAllocations);
+
+    auto elapsed = std::chrono::steady_clock::now() - frameStart;
+    engineMetrics.frameTime->Record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+    engineMetrics.frameArenaBytes->Set(static_cast<int64_t>(frameArena.Used()));
+    if (++frameCount > warmupFrames && lastFrameHeapAllocations > 0) steadyStateHeapFrames++;
+    if (debugMode && lastFrameHeapAllocations > 0){
+        std::cout << "frame made " << lastFrameHeapAllocations << " heap allocations\n";
+    }
 }
 
 Engine::~Engine(){
     if (debugMode)
     std::cout << "destroying graphics engine" << std::endl;
 
+    exporter.reset();
+    DestroyRaymarchPipeline();
+    DestroyFrameResources();
+    volume.reset();
+    primitives.reset();
+
     for (auto& frame : swapchainFrames){
         device.destroyImageView(frame.imageView);
     }
@@ -72,4 +388,7 @@ Engine::~Engine(){
     instance.destroy();
 
     glfwTerminate();
+
+    // stop the exporter last so its final snapshot covers teardown
+    metricsExporter.reset();
 }
\ No newline at end of file
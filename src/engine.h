@@ -2,18 +2,81 @@
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 #include <vulkan/vulkan.hpp>
+#include <array>
 #include "config.h"
+#include "metrics.h"
+#include "vkUtil/FrameArena.h"
 #include "vkUtil/SwapChainFrame.h"
 
 class Instance;
+namespace vkCompute { class Primitives; class SparseVolume; struct SparseVolumeInput; }
+namespace vkInterop { class Exporter; }
 
 class Engine{
 public:
-    Engine(bool debug);
+    Engine(bool debug, const std::string& metricsEndpoint = "");
     ~Engine();
+
+    metrics::Registry& Metrics() { return metricsRegistry; }
+
+    // validates the compute primitives against their CPU references and prints their throughput
+    bool BenchmarkPrimitives();
+
+    // polls window events; false once the window is gone
+    bool PollEvents();
+
+    // draws and presents one frame inside BeginFrame/EndFrame
+    void Render();
+
+    // frame boundaries: BeginFrame reclaims the frame arena and starts counting the thread's heap allocations, EndFrame publishes them
+    void BeginFrame();
+    void EndFrame();
+
+    // scratch that lives until the next BeginFrame; per-frame containers built between the boundaries belong here
+    std::pmr::memory_resource* FrameMemory() { return &frameArena; }
+    uint64_t LastFrameHeapAllocations() const { return lastFrameHeapAllocations; }
+    // frames past the warm-up that made any heap allocation on the render thread; a steady-state loop has none
+    uint64_t SteadyStateHeapFrames() const { return steadyStateHeapFrames; }
+
+    // sparse field shown by the ray-march pass; replaces any previous volume
+    vkCompute::SparseVolume& MakeVolume(const vkCompute::SparseVolumeInput& input);
+    vkCompute::SparseVolume* Volume() { return volume.get(); }
+
+    // fills a spherical shell into a fresh volume and returns its centre
+    std::array<float, 3> MakeVolumeDemo();
+
+    // camera Render() ray-marches the volume from; verticalFov in radians
+    void SetCamera(const float eye[3], const float target[3], float verticalFov = 0.8f);
+
+    // records the ray-march pass into swapchain image imageIndex; stepScale is in voxels
+    void RecordVolumeDraw(vk::CommandBuffer cmd, uint32_t imageIndex, const float inverseViewProjection[16], const float eye[3],
+                          float stepScale = 0.5f, float densityScale = 1.0f);
+
+    // shares results with consumer processes on this machine (see interop/Protocol.h); replaces any previous exporter
+    vkInterop::Exporter& MakeExporter(const std::string& name, uint32_t slotCount = 3);
+    vkInterop::Exporter* Exporter() { return exporter.get(); }
+
+    // exports a host visible "frame" buffer that Render() fills with the frame count every step
+    void ExportFrames(const std::string& name);
 private:
     bool debugMode = true;
 
+    // metrics
+    metrics::Registry metricsRegistry;
+    metrics::EngineMetrics engineMetrics{metrics::MakeEngineMetrics(metricsRegistry)};
+    std::unique_ptr<metrics::Exporter> metricsExporter;
+
+    // per-frame memory; anything reaching heapResource is general-purpose heap traffic, and
+    // frame heap counts cover every global allocation between BeginFrame and EndFrame
+    vkUtil::CountingResource heapResource{engineMetrics.heapAllocations};
+    vkUtil::FrameArena frameArena{1 << 20, &heapResource};
+    static constexpr uint64_t warmupFrames = 3;
+    uint64_t frameCount{0};
+    uint64_t frameStartHeapAllocations{0};
+    uint64_t lastFrameHeapAllocations{0};
+    uint64_t steadyStateHeapFrames{0};
+    std::chrono::steady_clock::time_point frameStart;
+
     int width{800}, height{600};
     GLFWwindow* window{nullptr};
 
@@ -27,6 +90,7 @@ private:
     // device
     vk::PhysicalDevice physicalDevice{nullptr};
     vk::Device device{nullptr};
+    uint32_t graphicsFamily{0};
     vk::Queue graphicsQueue{nullptr};
     vk::Queue presentQueue{nullptr};
     vk::SwapchainKHR swapchain;
@@ -34,10 +98,49 @@ private:
     vk::Format swapchainFormat;
     vk::Extent2D swapchainExtent;
 
+    // frame loop
+    vk::RenderPass renderpass{nullptr};
+    vk::CommandPool commandPool{nullptr};
+    size_t maxFramesInFlight{0}, frameNumber{0};
+
+    // compute
+    std::unique_ptr<vkCompute::Primitives> primitives;
+    std::unique_ptr<vkCompute::SparseVolume> volume;
+
+    // external export
+    std::unique_ptr<vkInterop::Exporter> exporter;
+    static constexpr vk::DeviceSize frameExportBytes = 64;
+    std::optional<uint32_t> frameExportResource;
+
+    // volume rendering
+    vk::PipelineLayout raymarchLayout{nullptr};
+    vk::Pipeline raymarchPipeline{nullptr};
+    float cameraRays[16]{};
+    float cameraEye[3]{};
+    // bricks streamed per frame, and the fence of the frame whose Flush last used the staging memory
+    static constexpr uint32_t volumeBrickBudget = 1024;
+    vk::Fence volumeFlushFence{nullptr};
+
     void BuildGlfwWindow();
 
     void MakeInstance();
 
 
     void MakeDevice();
+
+    void MakeFrameResources();
+
+    void DestroyFrameResources();
+
+    void BeginRenderpass(vk::CommandBuffer cmd, uint32_t imageIndex);
+
+    vkCompute::Primitives* ComputePrimitives();
+
+    void MakeCompute();
+
+    void MakeRaymarchPipeline();
+
+    void DestroyRaymarchPipeline();
+
+    void MakeMetrics(const std::string& endpoint);
 };
@@ -0,0 +1,32 @@
+#pragma once
+#include "config.h"
+#include "vkUtil/SwapChainFrame.h"
+
+namespace vkInit {
+    struct FramebufferInput {
+        vk::Device device;
+        vk::RenderPass renderpass;
+        vk::Extent2D swapchainExtent;
+    };
+
+    void MakeFramebuffers(const FramebufferInput& input, std::vector<vkUtil::SwapChainFrame>& frames, bool debug){
+        for (size_t i = 0; i < frames.size(); i++){
+            std::vector<vk::ImageView> attachments = { frames[i].imageView };
+
+            vk::FramebufferCreateInfo framebufferInfo = vk::FramebufferCreateInfo(
+                    vk::FramebufferCreateFlags(),
+                    input.renderpass,
+                    static_cast<uint32_t>(attachments.size()), attachments.data(),
+                    input.swapchainExtent.width, input.swapchainExtent.height,
+                    1
+            );
+
+            try{
+                frames[i].framebuffer = input.device.createFramebuffer(framebufferInfo);
+                if (debug) std::cout << "created framebuffer for frame " << i << "\n";
+            }catch(vk::SystemError err){
+                if (debug) std::cerr << "failed to create framebuffer for frame " << i << ": " << err.what() << "\n";
+            }
+        }
+    }
+}
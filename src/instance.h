@@ -66,6 +66,14 @@ namespace vkInit{
         return true;
     }
 
+    // the version MakeInstance requests: the loader's, capped at the 1.2 the compute primitives are written against
+    uint32_t InstanceApiVersion(){
+        uint32_t version{0};
+        vkEnumerateInstanceVersion(&version);
+        version &= ~(0xFFFU);
+        return std::max(std::min(version, VK_MAKE_API_VERSION(0, 1, 2, 0)), VK_MAKE_API_VERSION(0, 1, 0, 0));
+    }
+
     vk::Instance MakeInstance(bool debug, const char* appName){
         if (debug) std::cout << "making an instance" << std::endl;
 
@@ -81,7 +89,8 @@ namespace vkInit{
                       << VK_API_VERSION_PATCH(version) << "."
                       << VK_API_VERSION_PATCH(version) << std::endl;
         }
-        version = VK_MAKE_API_VERSION(0, 1, 0, 0);
+        // 1.2 brings subgroups, buffer device addresses and 64 bit atomics for the compute primitives
+        version = InstanceApiVersion();
         vk::ApplicationInfo appInfo = vk::ApplicationInfo(
                 appName,
                 version,
@@ -0,0 +1,348 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+#include "Protocol.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+
+/*
+ * Consumer side of the export handshake, for tools running next to the engine. Depends only on
+ * Vulkan and Protocol.h. The consumer's device must be created on the exporting GPU (see
+ * MatchesDevice) with ConsumerDeviceExtensions(), the timelineSemaphore feature, and
+ * bufferDeviceAddress when an exported buffer carries the device address flag. The dispatcher
+ * must be initialised with that device.
+ */
+namespace vkInterop {
+    inline std::vector<const char*> ConsumerDeviceExtensions() {
+        return {VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME, VK_KHR_EXTERNAL_SEMAPHORE_FD_EXTENSION_NAME};
+    }
+
+    struct ConsumerFrame {
+        uint64_t step;
+        uint32_t slot;
+    };
+
+#ifndef _WIN32
+    class Consumer {
+    public:
+        Consumer(const std::string& name, vk::PhysicalDevice physicalDevice, vk::Device device,
+                 const vk::detail::DispatchLoaderDynamic& dispatch, bool debug)
+            : device(device), dispatch(dispatch), debug(debug) {
+            header = MapHeader(name);
+            if (!header) throw std::runtime_error("no export named \"" + name + "\" is running");
+            try{
+                if (!MatchesHeader(*header, physicalDevice)) throw std::runtime_error("export \"" + name + "\" lives on a different device or driver");
+                ClaimRecord();
+                Connect();
+                ImportAll();
+            }catch(...){
+                Destroy();
+                throw;
+            }
+            if (debug) std::cout << "imported export \"" << name << "\" with " << header->resourceCount << " resources" << "\n";
+        }
+
+        ~Consumer() {
+            Destroy();
+        }
+
+        Consumer(const Consumer&) = delete;
+        Consumer& operator=(const Consumer&) = delete;
+
+        // true when the export is running on physicalDevice, so a tool can pick the right GPU before making its device
+        static bool MatchesDevice(const std::string& name, vk::PhysicalDevice physicalDevice) {
+            ExportHeader* mapped = MapHeader(name);
+            if (!mapped) return false;
+            bool matches = MatchesHeader(*mapped, physicalDevice);
+            munmap(mapped, sizeof(ExportHeader));
+            return matches;
+        }
+
+        /*
+         * Holds the newest published step not acquired before, once the GPU has finished it.
+         * Returns nothing when no new step arrives within timeout. The slot stays valid
+         * until Release() or the next Acquire(). GPU work that reads it must complete before
+         * either of those.
+         */
+        std::optional<ConsumerFrame> Acquire(std::chrono::nanoseconds timeout) {
+            Release();
+            auto deadline = std::chrono::steady_clock::now() + timeout;
+            while (ProducerAlive()){
+                uint64_t step = header->publishedStep.load(std::memory_order_acquire);
+                if (step != noStep && step != lastAcquired){
+                    record->readingStep.store(step, std::memory_order_seq_cst);
+                    if (header->writingStep.load(std::memory_order_seq_cst) >= step + header->slotCount){
+                        // the producer got to the slot first; try the newer step
+                        record->readingStep.store(noStep, std::memory_order_seq_cst);
+                        continue;
+                    }
+
+                    auto remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - std::chrono::steady_clock::now());
+                    vk::SemaphoreWaitInfo waitInfo = vk::SemaphoreWaitInfo(vk::SemaphoreWaitFlags(), 1, &timeline, &step);
+                    vk::Result result = device.waitSemaphores(waitInfo, static_cast<uint64_t>(std::max<int64_t>(remaining.count(), 0)), dispatch);
+                    if (result != vk::Result::eSuccess){
+                        record->readingStep.store(noStep, std::memory_order_seq_cst);
+                        return std::nullopt;
+                    }
+                    lastAcquired = step;
+                    return ConsumerFrame{step, SlotOf(step, header->slotCount)};
+                }
+
+                if (std::chrono::steady_clock::now() >= deadline) return std::nullopt;
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+            return std::nullopt;
+        }
+
+        void Release() {
+            if (record) record->readingStep.store(noStep, std::memory_order_seq_cst);
+        }
+
+        // ownership transfer for GPU readers; consumers that only use Mapped() skip both
+        void RecordAcquire(vk::CommandBuffer cmd, uint32_t slot, uint32_t queueFamilyIndex) const {
+            RecordOwnership(cmd, slot, VK_QUEUE_FAMILY_EXTERNAL, queueFamilyIndex, false);
+        }
+
+        void RecordRelease(vk::CommandBuffer cmd, uint32_t slot, uint32_t queueFamilyIndex) const {
+            RecordOwnership(cmd, slot, queueFamilyIndex, VK_QUEUE_FAMILY_EXTERNAL, true);
+        }
+
+        uint32_t FindResource(const std::string& resourceName) const {
+            for (uint32_t i = 0; i < header->resourceCount; i++){
+                if (resourceName == header->resources[i].name) return i;
+            }
+            throw std::out_of_range("export has no resource named \"" + resourceName + "\"");
+        }
+
+        const ResourceDescription& Description(uint32_t resource) const { return header->resources[resource]; }
+        uint32_t SlotCount() const { return header->slotCount; }
+        bool ProducerAlive() const { return header->producerAlive.load(std::memory_order_acquire) != 0; }
+
+        // host pointer to a host visible buffer slot, nullptr otherwise
+        const void* Mapped(uint32_t resource, uint32_t slot) const { return imports.at(resource * header->slotCount + slot).mapped; }
+        vk::Buffer Buffer(uint32_t resource, uint32_t slot) const { return imports.at(resource * header->slotCount + slot).buffer; }
+        vk::Image Image(uint32_t resource, uint32_t slot) const { return imports.at(resource * header->slotCount + slot).image; }
+
+    private:
+        struct Import {
+            vk::DeviceMemory memory{nullptr};
+            vk::Buffer buffer{nullptr};
+            vk::Image image{nullptr};
+            void* mapped{nullptr};
+        };
+
+        vk::Device device;
+        const vk::detail::DispatchLoaderDynamic& dispatch;
+        bool debug;
+
+        ExportHeader* header{nullptr};
+        ConsumerRecord* record{nullptr};
+        // set once the producer has the record index; from then on the producer frees the record
+        bool registered{false};
+        int connection{-1};
+        std::vector<Import> imports;
+        vk::Semaphore timeline{nullptr};
+        uint64_t lastAcquired{noStep};
+
+        static ExportHeader* MapHeader(const std::string& name) {
+            int shmFd = shm_open(SharedMemoryName(name).c_str(), O_RDWR, 0);
+            if (shmFd < 0) return nullptr;
+            struct stat status{};
+            void* mapping = MAP_FAILED;
+            if (fstat(shmFd, &status) == 0 && status.st_size >= static_cast<off_t>(sizeof(ExportHeader))){
+                mapping = mmap(nullptr, sizeof(ExportHeader), PROT_READ | PROT_WRITE, MAP_SHARED, shmFd, 0);
+            }
+            close(shmFd);
+            if (mapping == MAP_FAILED) return nullptr;
+
+            auto* mapped = static_cast<ExportHeader*>(mapping);
+            // producerAlive is published last, so everything before it is initialised once it reads 1
+            if (mapped->producerAlive.load(std::memory_order_acquire) == 0 || mapped->magic != exportMagic || mapped->version != exportVersion){
+                munmap(mapping, sizeof(ExportHeader));
+                return nullptr;
+            }
+            return mapped;
+        }
+
+        static bool MatchesHeader(const ExportHeader& exportHeader, vk::PhysicalDevice physicalDevice) {
+            auto properties = physicalDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceIDProperties>();
+            const auto& idProperties = properties.get<vk::PhysicalDeviceIDProperties>();
+            return std::memcmp(exportHeader.deviceUUID, idProperties.deviceUUID.data(), sizeof(exportHeader.deviceUUID)) == 0
+                   && std::memcmp(exportHeader.driverUUID, idProperties.driverUUID.data(), sizeof(exportHeader.driverUUID)) == 0;
+        }
+
+        void ClaimRecord() {
+            for (ConsumerRecord& candidate : header->consumers){
+                uint32_t expected = 0;
+                if (candidate.active.compare_exchange_strong(expected, 1, std::memory_order_acq_rel)){
+                    candidate.readingStep.store(noStep, std::memory_order_seq_cst);
+                    record = &candidate;
+                    return;
+                }
+            }
+            throw std::runtime_error("export already has the maximum number of consumers");
+        }
+
+        // once the index is sent the producer frees the record, when this connection closes or the handshake fails
+        void Connect() {
+            sockaddr_un address{};
+            address.sun_family = AF_UNIX;
+            std::strncpy(address.sun_path, header->socketPath, sizeof(address.sun_path) - 1);
+
+            connection = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (connection < 0 || connect(connection, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0){
+                throw std::runtime_error("failed to connect to export socket " + std::string(address.sun_path));
+            }
+            uint32_t index = static_cast<uint32_t>(record - header->consumers);
+            if (send(connection, &index, sizeof(index), MSG_NOSIGNAL) != static_cast<ssize_t>(sizeof(index))){
+                throw std::runtime_error("failed to register with the exporter");
+            }
+            registered = true;
+        }
+
+        void ImportAll() {
+            std::vector<int> fds = ReceiveFds(connection);
+            size_t expected = static_cast<size_t>(header->resourceCount) * header->slotCount + 1;
+            if (fds.size() != expected){
+                for (int fd : fds) close(fd);
+                throw std::runtime_error("exporter sent an unexpected number of handles");
+            }
+
+            // every successful import takes ownership of its fd; on failure the rest are closed here
+            size_t next = 0;
+            try{
+                for (uint32_t resource = 0; resource < header->resourceCount; resource++){
+                    for (uint32_t slot = 0; slot < header->slotCount; slot++){
+                        imports.push_back(ImportResource(header->resources[resource], fds[next]));
+                        next++;
+                    }
+                }
+
+                vk::SemaphoreTypeCreateInfo typeInfo = vk::SemaphoreTypeCreateInfo(vk::SemaphoreType::eTimeline, noStep);
+                vk::SemaphoreCreateInfo semaphoreInfo = vk::SemaphoreCreateInfo();
+                semaphoreInfo.pNext = &typeInfo;
+                timeline = device.createSemaphore(semaphoreInfo);
+                device.importSemaphoreFdKHR(vk::ImportSemaphoreFdInfoKHR(timeline, vk::SemaphoreImportFlags(),
+                                                                         vk::ExternalSemaphoreHandleTypeFlagBits::eOpaqueFd, fds[next]), dispatch);
+                next++;
+            }catch(...){
+                for (; next < fds.size(); next++) close(fds[next]);
+                throw;
+            }
+        }
+
+        Import ImportResource(const ResourceDescription& description, int fd) {
+            Import imported;
+            bool isImage = description.kind == ResourceKind::eImage;
+            if (isImage){
+                vk::ExternalMemoryImageCreateInfo externalInfo = vk::ExternalMemoryImageCreateInfo(vk::ExternalMemoryHandleTypeFlagBits::eOpaqueFd);
+                vk::ImageCreateInfo imageInfo = vk::ImageCreateInfo(
+                        vk::ImageCreateFlags(),
+                        static_cast<vk::ImageType>(description.imageType),
+                        static_cast<vk::Format>(description.format),
+                        vk::Extent3D(description.extent[0], description.extent[1], description.extent[2]),
+                        1, 1, vk::SampleCountFlagBits::e1,
+                        vk::ImageTiling::eOptimal, vk::ImageUsageFlags(description.usage),
+                        vk::SharingMode::eExclusive
+                );
+                imageInfo.pNext = &externalInfo;
+                imported.image = device.createImage(imageInfo);
+            } else {
+                vk::ExternalMemoryBufferCreateInfo externalInfo = vk::ExternalMemoryBufferCreateInfo(vk::ExternalMemoryHandleTypeFlagBits::eOpaqueFd);
+                vk::BufferCreateInfo bufferInfo = vk::BufferCreateInfo(
+                        vk::BufferCreateFlags(),
+                        description.size,
+                        vk::BufferUsageFlags(description.usage),
+                        vk::SharingMode::eExclusive
+                );
+                bufferInfo.pNext = &externalInfo;
+                imported.buffer = device.createBuffer(bufferInfo);
+            }
+            vk::MemoryDedicatedAllocateInfo dedicatedInfo = vk::MemoryDedicatedAllocateInfo(imported.image, imported.buffer);
+            vk::ImportMemoryFdInfoKHR importInfo = vk::ImportMemoryFdInfoKHR(vk::ExternalMemoryHandleTypeFlagBits::eOpaqueFd, fd);
+            vk::MemoryAllocateFlagsInfo allocateFlags = vk::MemoryAllocateFlagsInfo(vk::MemoryAllocateFlags(description.allocateFlags));
+            vk::MemoryAllocateInfo allocateInfo = vk::MemoryAllocateInfo(description.allocationSize, description.memoryTypeIndex);
+
+            const void* next = nullptr;
+            if (description.dedicated){
+                dedicatedInfo.pNext = next;
+                next = &dedicatedInfo;
+            }
+            importInfo.pNext = next;
+            next = &importInfo;
+            if (description.allocateFlags){
+                allocateFlags.pNext = next;
+                next = &allocateFlags;
+            }
+            allocateInfo.pNext = next;
+
+            try{
+                imported.memory = device.allocateMemory(allocateInfo);
+            }catch(vk::SystemError err){
+                if (imported.image) device.destroyImage(imported.image);
+                if (imported.buffer) device.destroyBuffer(imported.buffer);
+                throw std::runtime_error("failed to import exported memory: " + std::string(err.what()));
+            }
+
+            if (isImage) device.bindImageMemory(imported.image, imported.memory, 0);
+            else device.bindBufferMemory(imported.buffer, imported.memory, 0);
+            if (description.hostVisible) imported.mapped = device.mapMemory(imported.memory, 0, VK_WHOLE_SIZE);
+            return imported;
+        }
+
+        void RecordOwnership(vk::CommandBuffer cmd, uint32_t slot, uint32_t sourceFamily, uint32_t destinationFamily, bool release) const {
+            vk::AccessFlags accesses = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eTransferRead;
+            vk::PipelineStageFlags stages = vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eFragmentShader
+                    | vk::PipelineStageFlagBits::eTransfer;
+
+            std::array<vk::BufferMemoryBarrier, maxExportResources> bufferBarriers;
+            std::array<vk::ImageMemoryBarrier, maxExportResources> imageBarriers;
+            uint32_t bufferCount{0}, imageCount{0};
+            for (uint32_t resource = 0; resource < header->resourceCount; resource++){
+                const Import& imported = imports[resource * header->slotCount + slot];
+                if (imported.buffer){
+                    bufferBarriers[bufferCount++] = vk::BufferMemoryBarrier(
+                            release ? accesses : vk::AccessFlags(), release ? vk::AccessFlags() : accesses,
+                            sourceFamily, destinationFamily, imported.buffer, 0, VK_WHOLE_SIZE);
+                }
+                if (imported.image){
+                    imageBarriers[imageCount++] = vk::ImageMemoryBarrier(
+                            release ? accesses : vk::AccessFlags(), release ? vk::AccessFlags() : accesses,
+                            vk::ImageLayout::eGeneral, vk::ImageLayout::eGeneral, sourceFamily, destinationFamily,
+                            imported.image, vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1));
+                }
+            }
+            cmd.pipelineBarrier(release ? stages : vk::PipelineStageFlagBits::eTopOfPipe,
+                                release ? vk::PipelineStageFlagBits::eBottomOfPipe : stages,
+                                vk::DependencyFlags(), 0, nullptr, bufferCount, bufferBarriers.data(), imageCount, imageBarriers.data());
+        }
+
+        void Destroy() {
+            Release();
+            for (Import& imported : imports){
+                if (imported.mapped) device.unmapMemory(imported.memory);
+                if (imported.buffer) device.destroyBuffer(imported.buffer);
+                if (imported.image) device.destroyImage(imported.image);
+                if (imported.memory) device.freeMemory(imported.memory);
+            }
+            imports.clear();
+            if (timeline) device.destroySemaphore(timeline);
+            timeline = nullptr;
+
+            // a record whose index never reached the producer is ours to free, whether or not the socket connected
+            if (record && !registered) record->active.store(0, std::memory_order_release);
+            registered = false;
+            if (connection >= 0) close(connection);
+            connection = -1;
+            record = nullptr;
+            if (header) munmap(header, sizeof(ExportHeader));
+            header = nullptr;
+        }
+    };
+#endif
+}
@@ -0,0 +1,479 @@
+#pragma once
+#include "../config.h"
+#include "../metrics.h"
+#include "../vkUtil/Memory.h"
+#include "Protocol.h"
+
+#include <mutex>
+#include <thread>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <cstdlib>
+#include <poll.h>
+#endif
+
+namespace vkInterop {
+    /*
+     * Exports buffers and images to consumer processes without copies (see Protocol.h).
+     * Resources are added before Start(), each as a ring of slots so that a step can be
+     * written while consumers still read the previous ones.
+     *
+     * Per step, on the exporter's queue:
+     *     if (auto slot = exporter.BeginStep()) {
+     *         record: exporter.RecordAcquire(cmd, *slot), the writes, exporter.RecordRelease(cmd, *slot)
+     *         submit, then exporter.Publish(queue)
+     *     }
+     */
+    class Exporter {
+    public:
+        Exporter(vk::PhysicalDevice physicalDevice, vk::Device device, const vk::detail::DispatchLoaderDynamic& dispatch,
+                 uint32_t queueFamilyIndex, const std::string& name, uint32_t slotCount,
+                 metrics::EngineMetrics& engineMetrics, bool debug)
+            : physicalDevice(physicalDevice), device(device), dispatch(dispatch), queueFamilyIndex(queueFamilyIndex),
+              name(name), slotCount(slotCount), engineMetrics(engineMetrics), debug(debug) {
+#ifdef _WIN32
+            throw std::runtime_error("external memory export needs POSIX file descriptors");
+#else
+            if (slotCount < 2 || slotCount > maxExportSlots) throw std::invalid_argument("exporter slot count must be between 2 and 4");
+            if (name.empty() || name.find('/') != std::string::npos) throw std::invalid_argument("export names must be non-empty and contain no '/'");
+            if (debug) std::cout << "making exporter \"" << name << "\" with " << slotCount << " slots" << "\n";
+
+            vk::ExportSemaphoreCreateInfo exportInfo = vk::ExportSemaphoreCreateInfo(vk::ExternalSemaphoreHandleTypeFlagBits::eOpaqueFd);
+            vk::SemaphoreTypeCreateInfo typeInfo = vk::SemaphoreTypeCreateInfo(vk::SemaphoreType::eTimeline, noStep);
+            typeInfo.pNext = &exportInfo;
+            vk::SemaphoreCreateInfo semaphoreInfo = vk::SemaphoreCreateInfo();
+            semaphoreInfo.pNext = &typeInfo;
+            timeline = device.createSemaphore(semaphoreInfo);
+            timelineFd = device.getSemaphoreFdKHR(vk::SemaphoreGetFdInfoKHR(timeline, vk::ExternalSemaphoreHandleTypeFlagBits::eOpaqueFd), dispatch);
+#endif
+        }
+
+        ~Exporter() {
+#ifndef _WIN32
+            if (header) header->producerAlive.store(0, std::memory_order_release);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                running = false;
+            }
+            if (worker.joinable()) worker.join();
+            for (int connection : connections) close(connection);
+            ReleaseName();
+
+            device.waitIdle();
+            for (int fd : memoryFds) close(fd);
+            for (Resource& resource : resources){
+                for (vkUtil::Buffer& buffer : resource.buffers){
+                    engineMetrics.allocatedDeviceBytes->Add(-static_cast<int64_t>(buffer.allocationSize));
+                    vkUtil::DestroyBuffer(device, buffer);
+                }
+                for (vkUtil::Image& image : resource.images){
+                    engineMetrics.allocatedDeviceBytes->Add(-static_cast<int64_t>(image.size));
+                    vkUtil::DestroyImage(device, image);
+                }
+            }
+            if (timelineFd >= 0) close(timelineFd);
+            device.destroySemaphore(timeline);
+#endif
+        }
+
+        Exporter(const Exporter&) = delete;
+        Exporter& operator=(const Exporter&) = delete;
+
+        // host visible buffers can be read by consumers through a mapping, the rest only by their GPU work
+        uint32_t AddBuffer(const std::string& resourceName, vk::DeviceSize size, vk::BufferUsageFlags usage, bool hostVisible) {
+            ResourceDescription description = Describe(resourceName, ResourceKind::eBuffer);
+            Resource resource;
+            for (uint32_t slot = 0; slot < slotCount; slot++){
+                vkUtil::BufferInput input;
+                input.size = size;
+                input.usage = usage;
+                input.properties = hostVisible
+                        ? vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent
+                        : vk::MemoryPropertyFlagBits::eDeviceLocal;
+                input.physicalDevice = physicalDevice;
+                input.device = device;
+                input.exportHandleTypes = vk::ExternalMemoryHandleTypeFlagBits::eOpaqueFd;
+                resource.buffers.push_back(vkUtil::CreateBuffer(input));
+
+                const vkUtil::Buffer& buffer = resource.buffers.back();
+                engineMetrics.allocatedDeviceBytes->Add(static_cast<int64_t>(buffer.allocationSize));
+                memoryFds.push_back(ExportMemory(buffer.memory));
+                description.memoryTypeIndex = buffer.memoryTypeIndex;
+                description.allocationSize = buffer.allocationSize;
+                description.dedicated = buffer.dedicated ? 1 : 0;
+            }
+
+            bool deviceAddress = static_cast<bool>(usage & vk::BufferUsageFlagBits::eShaderDeviceAddress);
+            description.hostVisible = hostVisible ? 1 : 0;
+            description.allocateFlags = deviceAddress ? static_cast<uint32_t>(VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT) : 0;
+            description.usage = static_cast<uint32_t>(usage);
+            description.size = size;
+            return AddResource(description, std::move(resource));
+        }
+
+        // 2D or 3D image, single mip and layer, kept in eGeneral between steps
+        uint32_t AddImage(const std::string& resourceName, vk::ImageType type, vk::Extent3D extent, vk::Format format, vk::ImageUsageFlags usage) {
+            vk::PhysicalDeviceExternalImageFormatInfo externalInfo = vk::PhysicalDeviceExternalImageFormatInfo(vk::ExternalMemoryHandleTypeFlagBits::eOpaqueFd);
+            vk::PhysicalDeviceImageFormatInfo2 formatInfo = vk::PhysicalDeviceImageFormatInfo2(format, type, vk::ImageTiling::eOptimal, usage);
+            formatInfo.pNext = &externalInfo;
+            auto formatProperties = physicalDevice.getImageFormatProperties2<vk::ImageFormatProperties2, vk::ExternalImageFormatProperties>(formatInfo);
+            const auto& externalProperties = formatProperties.get<vk::ExternalImageFormatProperties>().externalMemoryProperties;
+            if (!(externalProperties.externalMemoryFeatures & vk::ExternalMemoryFeatureFlagBits::eExportable)){
+                throw std::runtime_error("image format " + vk::to_string(format) + " cannot be exported");
+            }
+
+            ResourceDescription description = Describe(resourceName, ResourceKind::eImage);
+            Resource resource;
+            for (uint32_t slot = 0; slot < slotCount; slot++){
+                vkUtil::ImageInput input;
+                input.type = type;
+                input.extent = extent;
+                input.format = format;
+                input.usage = usage;
+                input.physicalDevice = physicalDevice;
+                input.device = device;
+                input.exportHandleTypes = vk::ExternalMemoryHandleTypeFlagBits::eOpaqueFd;
+                resource.images.push_back(vkUtil::CreateImage(input));
+
+                const vkUtil::Image& image = resource.images.back();
+                engineMetrics.allocatedDeviceBytes->Add(static_cast<int64_t>(image.size));
+                memoryFds.push_back(ExportMemory(image.memory));
+                description.memoryTypeIndex = image.memoryTypeIndex;
+                description.allocationSize = image.size;
+                description.dedicated = image.dedicated ? 1 : 0;
+            }
+
+            description.usage = static_cast<uint32_t>(usage);
+            description.format = static_cast<uint32_t>(format);
+            description.extent[0] = extent.width;
+            description.extent[1] = extent.height;
+            description.extent[2] = extent.depth;
+            description.imageType = static_cast<uint32_t>(type);
+            description.layout = static_cast<uint32_t>(vk::ImageLayout::eGeneral);
+            return AddResource(description, std::move(resource));
+        }
+
+        // publishes the header and starts handing out fds; no resources can be added afterwards
+        void Start() {
+#ifndef _WIN32
+            if (header) return;
+            // the exclusive create doubles as the lock on the name, so it comes before the socket
+            int shmFd = shm_open(SharedMemoryName(name).c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+            if (shmFd < 0 && errno == EEXIST){
+                throw std::runtime_error("export \"" + name + "\" is already running (if its producer died, remove /dev/shm"
+                                         + SharedMemoryName(name) + ")");
+            }
+            if (shmFd < 0) throw std::runtime_error("failed to create export shared memory " + SharedMemoryName(name));
+            void* mapping = ftruncate(shmFd, sizeof(ExportHeader)) == 0
+                    ? mmap(nullptr, sizeof(ExportHeader), PROT_READ | PROT_WRITE, MAP_SHARED, shmFd, 0)
+                    : MAP_FAILED;
+            close(shmFd);
+            if (mapping == MAP_FAILED){
+                shm_unlink(SharedMemoryName(name).c_str());
+                throw std::runtime_error("failed to map export shared memory " + SharedMemoryName(name));
+            }
+            header = new (mapping) ExportHeader{};
+
+            socketDirectory = SocketDirectory(ownsSocketDirectory);
+            socketPath = socketDirectory + "/mmeas-" + name + ".sock";
+            listenFd = socketDirectory.empty() ? -1 : OpenSocket(socketPath);
+            if (listenFd < 0){
+                std::string path = socketDirectory.empty() ? "directory" : socketPath;
+                ReleaseName();
+                throw std::runtime_error("failed to open export socket " + path);
+            }
+
+            auto properties = physicalDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceIDProperties>();
+            const auto& idProperties = properties.get<vk::PhysicalDeviceIDProperties>();
+            std::memcpy(header->deviceUUID, idProperties.deviceUUID.data(), sizeof(header->deviceUUID));
+            std::memcpy(header->driverUUID, idProperties.driverUUID.data(), sizeof(header->driverUUID));
+            socketPath.copy(header->socketPath, sizeof(header->socketPath) - 1);
+            header->magic = exportMagic;
+            header->version = exportVersion;
+            header->resourceCount = static_cast<uint32_t>(resources.size());
+            header->slotCount = slotCount;
+            for (size_t i = 0; i < resources.size(); i++) header->resources[i] = resources[i].description;
+            header->producerAlive.store(1, std::memory_order_release);
+
+            worker = std::thread([this] { Serve(); });
+            if (debug) std::cout << "exporting " << resources.size() << " resources as \"" << name << "\"\n";
+#endif
+        }
+
+        // slot to write the next step into, or nothing when a consumer still holds that slot
+        std::optional<uint32_t> BeginStep() {
+            if (!header) throw std::logic_error("exporter used before Start()");
+            uint64_t step = lastStep + 1;
+            uint32_t slot = SlotOf(step, slotCount);
+
+            header->writingStep.store(step, std::memory_order_seq_cst);
+            for (ConsumerRecord& consumer : header->consumers){
+                uint64_t reading = consumer.readingStep.load(std::memory_order_seq_cst);
+                if (reading != noStep && SlotOf(reading, slotCount) == slot){
+                    header->writingStep.store(lastStep, std::memory_order_seq_cst);
+                    engineMetrics.exportSkippedSteps->Add();
+                    return std::nullopt;
+                }
+            }
+            openStep = step;
+            return slot;
+        }
+
+        // takes the slot's resources back from consumers before the step writes them
+        void RecordAcquire(vk::CommandBuffer cmd, uint32_t slot) {
+            SlotState& state = slotStates[slot];
+            RecordOwnership(cmd, slot, state.released ? VK_QUEUE_FAMILY_EXTERNAL : VK_QUEUE_FAMILY_IGNORED,
+                            state.released ? queueFamilyIndex : VK_QUEUE_FAMILY_IGNORED,
+                            state.initialized ? vk::ImageLayout::eGeneral : vk::ImageLayout::eUndefined, false);
+            state.initialized = true;
+            state.released = false;
+        }
+
+        // hands the slot's resources to consumers; also makes host visible buffers readable from the host
+        void RecordRelease(vk::CommandBuffer cmd, uint32_t slot) {
+            RecordOwnership(cmd, slot, queueFamilyIndex, VK_QUEUE_FAMILY_EXTERNAL, vk::ImageLayout::eGeneral, true);
+            slotStates[slot].released = true;
+        }
+
+        // signals the step on the timeline after everything submitted so far and makes it visible to consumers
+        void Publish(vk::Queue queue) {
+            if (openStep == noStep) throw std::logic_error("Publish() without a successful BeginStep()");
+            vk::TimelineSemaphoreSubmitInfo timelineInfo = vk::TimelineSemaphoreSubmitInfo(0, nullptr, 1, &openStep);
+            vk::SubmitInfo submitInfo = vk::SubmitInfo(0, nullptr, nullptr, 0, nullptr, 1, &timeline);
+            submitInfo.pNext = &timelineInfo;
+            {
+                metrics::ScopedTimer timer(*engineMetrics.queueSubmitLatency);
+                queue.submit(submitInfo, nullptr);
+            }
+
+            header->publishedStep.store(openStep, std::memory_order_release);
+            lastStep = openStep;
+            openStep = noStep;
+            engineMetrics.exportedSteps->Add();
+        }
+
+        const vkUtil::Buffer& Buffer(uint32_t resource, uint32_t slot) const { return resources.at(resource).buffers.at(slot); }
+        const vkUtil::Image& Image(uint32_t resource, uint32_t slot) const { return resources.at(resource).images.at(slot); }
+        uint32_t SlotCount() const { return slotCount; }
+        uint64_t LastStep() const { return lastStep; }
+
+    private:
+        struct Resource {
+            ResourceDescription description;
+            std::vector<vkUtil::Buffer> buffers;
+            std::vector<vkUtil::Image> images;
+        };
+
+        // whether a slot was ever written and whether consumers currently own it
+        struct SlotState {
+            bool initialized{false};
+            bool released{false};
+        };
+
+        vk::PhysicalDevice physicalDevice;
+        vk::Device device;
+        const vk::detail::DispatchLoaderDynamic& dispatch;
+        uint32_t queueFamilyIndex;
+        std::string name;
+        uint32_t slotCount;
+        metrics::EngineMetrics& engineMetrics;
+        bool debug;
+
+        std::vector<Resource> resources;
+        std::array<SlotState, maxExportSlots> slotStates{};
+        std::vector<int> memoryFds;
+        vk::Semaphore timeline{nullptr};
+        int timelineFd{-1};
+        uint64_t lastStep{noStep};
+        uint64_t openStep{noStep};
+
+        ExportHeader* header{nullptr};
+        std::string socketDirectory;
+        bool ownsSocketDirectory{false};
+        std::string socketPath;
+        int listenFd{-1};
+        std::vector<int> connections;
+        std::mutex mutex;
+        bool running{true};
+        std::thread worker;
+
+        ResourceDescription Describe(const std::string& resourceName, ResourceKind kind) const {
+            if (header) throw std::logic_error("resources must be exported before Start()");
+            if (resources.size() >= maxExportResources) throw std::length_error("too many exported resources");
+            ResourceDescription description{};
+            resourceName.copy(description.name, sizeof(description.name) - 1);
+            description.kind = kind;
+            return description;
+        }
+
+        uint32_t AddResource(const ResourceDescription& description, Resource resource) {
+            resource.description = description;
+            resources.push_back(std::move(resource));
+            return static_cast<uint32_t>(resources.size() - 1);
+        }
+
+        int ExportMemory(vk::DeviceMemory memory) {
+            return device.getMemoryFdKHR(vk::MemoryGetFdInfoKHR(memory, vk::ExternalMemoryHandleTypeFlagBits::eOpaqueFd), dispatch);
+        }
+
+        void RecordOwnership(vk::CommandBuffer cmd, uint32_t slot, uint32_t sourceFamily, uint32_t destinationFamily,
+                             vk::ImageLayout oldLayout, bool release) {
+            vk::AccessFlags writes = vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eTransferWrite | vk::AccessFlagBits::eColorAttachmentWrite;
+            vk::AccessFlags accesses = writes | vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eTransferRead;
+            vk::PipelineStageFlags stages = vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eTransfer
+                    | vk::PipelineStageFlagBits::eColorAttachmentOutput;
+
+            // bounded by maxExportResources, so recording a step never allocates
+            std::array<vk::BufferMemoryBarrier, maxExportResources> bufferBarriers;
+            std::array<vk::ImageMemoryBarrier, maxExportResources> imageBarriers;
+            uint32_t bufferCount{0}, imageCount{0};
+            for (const Resource& resource : resources){
+                if (!resource.buffers.empty()){
+                    bufferBarriers[bufferCount++] = vk::BufferMemoryBarrier(
+                            release ? writes : vk::AccessFlags(), release ? vk::AccessFlags() : accesses,
+                            sourceFamily, destinationFamily, resource.buffers[slot].buffer, 0, VK_WHOLE_SIZE);
+                }
+                if (!resource.images.empty()){
+                    imageBarriers[imageCount++] = vk::ImageMemoryBarrier(
+                            release ? writes : vk::AccessFlags(), release ? vk::AccessFlags() : accesses,
+                            oldLayout, vk::ImageLayout::eGeneral, sourceFamily, destinationFamily, resource.images[slot].image,
+                            vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1));
+                }
+            }
+
+            // host readers of mapped buffers need the writes made available to the host domain
+            vk::MemoryBarrier hostBarrier = vk::MemoryBarrier(writes, vk::AccessFlagBits::eHostRead);
+            cmd.pipelineBarrier(release ? stages : vk::PipelineStageFlagBits::eTopOfPipe,
+                                release ? stages | vk::PipelineStageFlagBits::eHost : stages,
+                                vk::DependencyFlags(), release ? 1 : 0, &hostBarrier,
+                                bufferCount, bufferBarriers.data(), imageCount, imageBarriers.data());
+        }
+
+#ifndef _WIN32
+        /*
+         * $XDG_RUNTIME_DIR when it is a directory only we can use, otherwise a fresh 0700
+         * directory under /tmp that the exporter removes again. Either way no other user can
+         * create, replace or connect to the socket.
+         */
+        static std::string SocketDirectory(bool& owned) {
+            owned = false;
+            const char* runtime = std::getenv("XDG_RUNTIME_DIR");
+            struct stat info{};
+            if (runtime && runtime[0] == '/' && lstat(runtime, &info) == 0 && S_ISDIR(info.st_mode)
+                && info.st_uid == geteuid() && (info.st_mode & 0077) == 0){
+                return runtime;
+            }
+
+            char pattern[] = "/tmp/mmeas-XXXXXX";
+            if (!mkdtemp(pattern)) return {};
+            owned = true;
+            return pattern;
+        }
+
+        static int OpenSocket(const std::string& path) {
+            sockaddr_un address{};
+            if (path.size() >= sizeof(address.sun_path)) return -1;
+            address.sun_family = AF_UNIX;
+            path.copy(address.sun_path, path.size());
+
+            int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (fd < 0) return -1;
+            // a socket left by a crashed producer of the same name; the shared memory lock says it is gone
+            unlink(path.c_str());
+            // bind creates the socket file with the umask applied, so it is never reachable with wider permissions
+            mode_t mask = umask(0077);
+            int bound = bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+            umask(mask);
+            if (bound != 0 || listen(fd, maxExportConsumers) != 0){
+                close(fd);
+                return -1;
+            }
+            return fd;
+        }
+
+        // undoes Start(): the socket, its private directory and the shared memory name
+        void ReleaseName() {
+            if (listenFd >= 0){
+                close(listenFd);
+                unlink(socketPath.c_str());
+                listenFd = -1;
+            }
+            if (ownsSocketDirectory) rmdir(socketDirectory.c_str());
+            ownsSocketDirectory = false;
+            if (header){
+                munmap(header, sizeof(ExportHeader));
+                shm_unlink(SharedMemoryName(name).c_str());
+                header = nullptr;
+            }
+        }
+
+        // a record the consumer claimed in shared memory and no other connection registered
+        bool Claimable(uint32_t record, const std::vector<uint32_t>& connectionRecords) const {
+            return record < maxExportConsumers && header->consumers[record].active.load(std::memory_order_acquire) != 0
+                   && std::find(connectionRecords.begin(), connectionRecords.end(), record) == connectionRecords.end();
+        }
+
+        void FreeRecord(uint32_t record) {
+            ConsumerRecord& consumer = header->consumers[record];
+            consumer.readingStep.store(noStep, std::memory_order_seq_cst);
+            consumer.active.store(0, std::memory_order_release);
+        }
+
+        /*
+         * A consumer connects, sends the index of the ConsumerRecord it claimed and gets the fds.
+         * The connection stays open; when it drops the record is freed, so a crashed consumer
+         * cannot hold a slot forever.
+         */
+        void Serve() {
+            std::vector<uint32_t> connectionRecords;
+            std::vector<int> fds = memoryFds;
+            fds.push_back(timelineFd);
+
+            while (true){
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (!running) return;
+                }
+                std::vector<pollfd> pending = {{listenFd, POLLIN, 0}};
+                for (int connection : connections) pending.push_back({connection, POLLIN, 0});
+                if (poll(pending.data(), pending.size(), 100) <= 0) continue;
+
+                for (size_t i = pending.size() - 1; i >= 1; i--){
+                    if (!pending[i].revents) continue;
+                    uint32_t record{maxExportConsumers};
+                    ssize_t received = recv(connections[i - 1], &record, sizeof(record), MSG_DONTWAIT);
+                    if (received < 0 && (errno == EAGAIN || errno == EINTR)) continue;
+
+                    // the record index is the only message; anything else, or a second one, ends the connection
+                    if (received == static_cast<ssize_t>(sizeof(record)) && connectionRecords[i - 1] == maxExportConsumers
+                        && Claimable(record, connectionRecords)){
+                        if (SendFds(connections[i - 1], fds)){
+                            connectionRecords[i - 1] = record;
+                            engineMetrics.exportConsumers->Add(1);
+                            continue;
+                        }
+                        if (debug) std::cerr << "failed to send export fds to consumer " << record << "\n";
+                        FreeRecord(record);
+                    }
+
+                    if (connectionRecords[i - 1] < maxExportConsumers){
+                        FreeRecord(connectionRecords[i - 1]);
+                        engineMetrics.exportConsumers->Add(-1);
+                    }
+                    close(connections[i - 1]);
+                    connections.erase(connections.begin() + static_cast<std::ptrdiff_t>(i - 1));
+                    connectionRecords.erase(connectionRecords.begin() + static_cast<std::ptrdiff_t>(i - 1));
+                }
+
+                if (pending[0].revents & POLLIN){
+                    int client = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+                    if (client < 0) continue;
+                    connections.push_back(client);
+                    connectionRecords.push_back(maxExportConsumers);
+                }
+            }
+        }
+#endif
+    };
+}
@@ -0,0 +1,143 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Handshake between the engine and consumer processes on the same machine. Shared by
+ * Exporter.h and Consumer.h and free of engine headers, so tools only need this directory.
+ *
+ * The producer publishes an ExportHeader in POSIX shared memory "/mmeas-<name>". It describes
+ * every exported resource and carries the step counters. Consumers connect to the Unix socket
+ * named in the header and receive, through SCM_RIGHTS, one memory fd per resource and slot
+ * (resource-major) followed by the timeline semaphore fd.
+ *
+ * Steps are numbered from 1. Step s is written to slot s % slotCount and is complete on the
+ * GPU once the timeline semaphore reaches s. A consumer holding a step stores it in its
+ * readingStep. The producer announces writingStep before touching a slot, and it skips a
+ * step rather than overwrite a slot that a consumer holds. Both sides use sequentially
+ * consistent stores followed by loads, so at least one of them sees the conflict.
+ */
+namespace vkInterop {
+    constexpr uint32_t exportMagic = 0x4D4D4558;
+    constexpr uint32_t exportVersion = 1;
+    constexpr uint32_t maxExportResources = 16;
+    constexpr uint32_t maxExportSlots = 4;
+    constexpr uint32_t maxExportConsumers = 8;
+    constexpr uint32_t maxExportFds = maxExportResources * maxExportSlots + 1;
+    constexpr uint64_t noStep = 0;
+
+    enum class ResourceKind : uint32_t {
+        eBuffer = 0,
+        eImage = 1
+    };
+
+    // what an importer needs to recreate one slot of a resource; Vulkan enums and flags as raw values
+    struct ResourceDescription {
+        char name[32];
+        ResourceKind kind;
+        uint32_t memoryTypeIndex;
+        uint64_t allocationSize;
+        uint32_t dedicated;
+        uint32_t hostVisible;
+        uint32_t allocateFlags;
+        uint32_t usage;
+        uint64_t size;
+        uint32_t format;
+        uint32_t imageType;
+        uint32_t extent[3];
+        // layout images are left in between steps
+        uint32_t layout;
+    };
+
+    struct ConsumerRecord {
+        std::atomic<uint32_t> active;
+        std::atomic<uint64_t> readingStep;
+    };
+
+    struct ExportHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint8_t deviceUUID[16];
+        uint8_t driverUUID[16];
+        char socketPath[108];
+        uint32_t resourceCount;
+        uint32_t slotCount;
+        ResourceDescription resources[maxExportResources];
+
+        std::atomic<uint32_t> producerAlive;
+        std::atomic<uint64_t> writingStep;
+        std::atomic<uint64_t> publishedStep;
+        ConsumerRecord consumers[maxExportConsumers];
+    };
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared memory counters must be lock free");
+
+    inline std::string SharedMemoryName(const std::string& exportName) { return "/mmeas-" + exportName; }
+
+    inline uint32_t SlotOf(uint64_t step, uint32_t slotCount) { return static_cast<uint32_t>(step % slotCount); }
+
+#ifndef _WIN32
+    // one message: the fd count as payload, the fds as ancillary data
+    inline bool SendFds(int socketFd, const std::vector<int>& fds) {
+        if (fds.empty() || fds.size() > maxExportFds) return false;
+        uint32_t count = static_cast<uint32_t>(fds.size());
+        iovec payload{&count, sizeof(count)};
+
+        std::vector<char> control(CMSG_SPACE(sizeof(int) * fds.size()));
+        msghdr message{};
+        message.msg_iov = &payload;
+        message.msg_iovlen = 1;
+        message.msg_control = control.data();
+        message.msg_controllen = control.size();
+
+        cmsghdr* header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+        std::memcpy(CMSG_DATA(header), fds.data(), sizeof(int) * fds.size());
+
+        return sendmsg(socketFd, &message, MSG_NOSIGNAL) == static_cast<ssize_t>(sizeof(count));
+    }
+
+    // the received fds belong to the caller; empty on any error
+    inline std::vector<int> ReceiveFds(int socketFd) {
+        uint32_t count{0};
+        iovec payload{&count, sizeof(count)};
+
+        std::vector<char> control(CMSG_SPACE(sizeof(int) * maxExportFds));
+        msghdr message{};
+        message.msg_iov = &payload;
+        message.msg_iovlen = 1;
+        message.msg_control = control.data();
+        message.msg_controllen = control.size();
+
+        ssize_t received = recvmsg(socketFd, &message, 0);
+        std::vector<int> fds;
+        for (cmsghdr* header = CMSG_FIRSTHDR(&message); received > 0 && header; header = CMSG_NXTHDR(&message, header)){
+            if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS) continue;
+            size_t fdCount = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            size_t start = fds.size();
+            fds.resize(start + fdCount);
+            std::memcpy(fds.data() + start, CMSG_DATA(header), sizeof(int) * fdCount);
+        }
+
+        if (received != static_cast<ssize_t>(sizeof(count)) || fds.size() != count || (message.msg_flags & MSG_CTRUNC)){
+            for (int fd : fds) close(fd);
+            return {};
+        }
+        for (int fd : fds) fcntl(fd, F_SETFD, FD_CLOEXEC);
+        return fds;
+    }
+#endif
+}
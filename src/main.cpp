@@ -1,17 +1,71 @@
 #include "engine.h"
+#include <cmath>
+#include <cstdlib>
 
 int main(int argc, char* argv[]) {
     bool debugMode = false;
+    bool benchmarkPrimitives = false;
+    bool volumeDemo = false;
+    std::string metricsEndpoint;
+    std::string exportName;
+    // 0 runs until the window is closed
+    uint64_t frameLimit = 0;
 
     for(int i=1;i<argc;i++){
         if (strcmp(argv[i], "--debugMode") == 0){
             debugMode = true;
+        } else if (strcmp(argv[i], "--benchmarkPrimitives") == 0){
+            benchmarkPrimitives = true;
+        } else if (strcmp(argv[i], "--volumeDemo") == 0){
+            volumeDemo = true;
+        } else if (strcmp(argv[i], "--metrics") == 0 && i + 1 < argc){
+            metricsEndpoint = argv[++i];
+        } else if (strcmp(argv[i], "--export") == 0 && i + 1 < argc){
+            exportName = argv[++i];
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc){
+            frameLimit = std::strtoull(argv[++i], nullptr, 10);
         }
     }
 
-    Engine* graphicsEngine = new Engine(debugMode);
+    Engine* graphicsEngine = new Engine(debugMode, metricsEndpoint);
+
+    int status = 0;
+    if (benchmarkPrimitives){
+        if (!graphicsEngine->BenchmarkPrimitives()) status = 1;
+    } else {
+        std::array<float, 3> center{};
+        if (volumeDemo){
+            try{
+                center = graphicsEngine->MakeVolumeDemo();
+            }catch(const std::exception& err){
+                std::cerr << "volume demo is unavailable: " << err.what() << "\n";
+                volumeDemo = false;
+                status = 1;
+            }
+        }
+        if (!exportName.empty()){
+            try{
+                graphicsEngine->ExportFrames(exportName);
+            }catch(const std::exception& err){
+                std::cerr << "export is unavailable: " << err.what() << "\n";
+                status = 1;
+            }
+        }
+        for (uint64_t frame = 0; (frameLimit == 0 || frame < frameLimit) && graphicsEngine->PollEvents(); frame++){
+            if (volumeDemo){
+                float angle = 0.01f * static_cast<float>(frame);
+                float eye[3] = {center[0] + 150.0f * std::sin(angle), center[1] + 40.0f, center[2] - 150.0f * std::cos(angle)};
+                graphicsEngine->SetCamera(eye, center.data());
+            }
+            graphicsEngine->Render();
+        }
+        if (graphicsEngine->SteadyStateHeapFrames() > 0){
+            std::cerr << graphicsEngine->SteadyStateHeapFrames() << " frames after warm-up allocated from the heap\n";
+            status = 1;
+        }
+    }
 
     delete graphicsEngine;
 
-    return 0;
+    return status;
 }
\ No newline at end of file
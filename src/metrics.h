@@ -0,0 +1,426 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <condition_variable>
+
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace metrics {
+    /*
+     * Hot-path updates never take a lock: every writer thread is pinned to one of
+     * shardCount cache-line sized slots and only does a relaxed fetch_add there.
+     * Readers (the exporter) sum the shards, so a scrape is slightly racy but never blocks.
+     */
+    constexpr size_t shardCount = 16;
+
+    inline size_t ShardIndex() {
+        static std::atomic<size_t> nextShard{0};
+        thread_local size_t shard = nextShard.fetch_add(1, std::memory_order_relaxed) % shardCount;
+        return shard;
+    }
+
+    inline uint32_t Log2(uint64_t v) {
+        uint32_t log2{0};
+        for (uint32_t step = 32; step > 0; step >>= 1) {
+            if (v >> step) {
+                v >>= step;
+                log2 += step;
+            }
+        }
+        return log2;
+    }
+
+    struct alignas(64) PaddedCounter {
+        std::atomic<uint64_t> value{0};
+    };
+
+    class Counter {
+    public:
+        Counter(std::string name, std::string help) : name(std::move(name)), help(std::move(help)) {}
+
+        void Add(uint64_t n = 1) { shards[ShardIndex()].value.fetch_add(n, std::memory_order_relaxed); }
+
+        uint64_t Value() const {
+            uint64_t total{0};
+            for (const auto& shard : shards) total += shard.value.load(std::memory_order_relaxed);
+            return total;
+        }
+
+        void Write(std::ostream& out) const {
+            out << "# HELP " << name << " " << help << "\n";
+            out << "# TYPE " << name << " counter\n";
+            out << name << " " << Value() << "\n";
+        }
+
+    private:
+        std::string name, help;
+        std::array<PaddedCounter, shardCount> shards;
+    };
+
+    // several threads update gauges (the engine, the export worker); Set and Add are each atomic, so concurrent Adds never lose updates
+    class Gauge {
+    public:
+        Gauge(std::string name, std::string help) : name(std::move(name)), help(std::move(help)) {}
+
+        void Set(int64_t v) { value.store(v, std::memory_order_relaxed); }
+        void Add(int64_t n) { value.fetch_add(n, std::memory_order_relaxed); }
+        int64_t Value() const { return value.load(std::memory_order_relaxed); }
+
+        void Write(std::ostream& out) const {
+            out << "# HELP " << name << " " << help << "\n";
+            out << "# TYPE " << name << " gauge\n";
+            out << name << " " << Value() << "\n";
+        }
+
+    private:
+        std::string name, help;
+        std::atomic<int64_t> value{0};
+    };
+
+    /*
+     * HDR-style log-linear histogram over unsigned integer samples (nanoseconds, bytes, ...).
+     * Each power of two is split into 2^subBucketBits linear sub-buckets, which bounds the
+     * relative error to 1/2^subBucketBits over the whole 64 bit range with a fixed bucket count.
+     * scale converts a recorded integer unit into the exported one (1e-9 for ns -> seconds).
+     */
+    class Histogram {
+    public:
+        static constexpr uint32_t subBucketBits = 3;
+        static constexpr uint32_t subBucketCount = 1u << subBucketBits;
+        static constexpr uint32_t bucketCount = (64 - subBucketBits + 1) * subBucketCount;
+
+        Histogram(std::string name, std::string help, double scale)
+            : name(std::move(name)), help(std::move(help)), scale(scale), shards(new Shard[shardCount]) {}
+
+        static uint32_t BucketIndex(uint64_t v) {
+            if (v < subBucketCount) return static_cast<uint32_t>(v);
+            uint32_t shift = Log2(v) - subBucketBits;
+            return ((shift + 1) << subBucketBits) + static_cast<uint32_t>((v >> shift) - subBucketCount);
+        }
+
+        // largest sample value that still lands in bucket index
+        static uint64_t BucketUpperBound(uint32_t index) {
+            if (index < subBucketCount) return index;
+            uint32_t shift = (index >> subBucketBits) - 1;
+            uint64_t mantissa = subBucketCount + (index & (subBucketCount - 1));
+            return ((mantissa + 1) << shift) - 1;
+        }
+
+        void Record(uint64_t v) {
+            Shard& shard = shards[ShardIndex()];
+            shard.buckets[BucketIndex(v)].fetch_add(1, std::memory_order_relaxed);
+            shard.sum.fetch_add(v, std::memory_order_relaxed);
+        }
+
+        // summed from the buckets like Write's _count, so the two always agree
+        uint64_t Count() const {
+            uint64_t total{0};
+            for (size_t s = 0; s < shardCount; s++) {
+                for (const auto& bucket : shards[s].buckets) total += bucket.load(std::memory_order_relaxed);
+            }
+            return total;
+        }
+
+        /*
+         * Only populated buckets are emitted; le bounds are fixed by the bucket layout, so series
+         * stay stable across scrapes once a bucket has been hit. +Inf and _count are the merged
+         * bucket total, so they match the last bucket; bounds are printed in full so neighbouring
+         * buckets never share a label.
+         */
+        void Write(std::ostream& out) const {
+            std::array<uint64_t, bucketCount> merged{};
+            uint64_t sum{0};
+            for (size_t s = 0; s < shardCount; s++) {
+                for (uint32_t i = 0; i < bucketCount; i++) merged[i] += shards[s].buckets[i].load(std::memory_order_relaxed);
+                sum += shards[s].sum.load(std::memory_order_relaxed);
+            }
+
+            std::streamsize precision = out.precision(std::numeric_limits<double>::max_digits10);
+            out << "# HELP " << name << " " << help << "\n";
+            out << "# TYPE " << name << " histogram\n";
+            uint64_t cumulative{0};
+            for (uint32_t i = 0; i < bucketCount; i++) {
+                if (merged[i] == 0) continue;
+                cumulative += merged[i];
+                out << name << "_bucket{le=\"" << static_cast<double>(BucketUpperBound(i)) * scale << "\"} " << cumulative << "\n";
+            }
+            out << name << "_bucket{le=\"+Inf\"} " << cumulative << "\n";
+            out << name << "_sum " << static_cast<double>(sum) * scale << "\n";
+            out << name << "_count " << cumulative << "\n";
+            out.precision(precision);
+        }
+
+    private:
+        struct alignas(64) Shard {
+            std::array<std::atomic<uint64_t>, bucketCount> buckets{};
+            std::atomic<uint64_t> sum{0};
+        };
+
+        std::string name, help;
+        double scale;
+        std::unique_ptr<Shard[]> shards;
+    };
+
+    // records the lifetime of the scope in nanoseconds
+    class ScopedTimer {
+    public:
+        explicit ScopedTimer(Histogram& histogram) : histogram(histogram), start(std::chrono::steady_clock::now()) {}
+        ~ScopedTimer() {
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            histogram.Record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+        }
+
+    private:
+        Histogram& histogram;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    /*
+     * Owns every metric. Registration and export lock, updates don't; references handed out
+     * stay valid for the lifetime of the registry.
+     */
+    class Registry {
+    public:
+        Counter& MakeCounter(const std::string& name, const std::string& help) {
+            std::lock_guard<std::mutex> lock(mutex);
+            counters.emplace_back(name, help);
+            return counters.back();
+        }
+
+        Gauge& MakeGauge(const std::string& name, const std::string& help) {
+            std::lock_guard<std::mutex> lock(mutex);
+            gauges.emplace_back(name, help);
+            return gauges.back();
+        }
+
+        Histogram& MakeHistogram(const std::string& name, const std::string& help, double scale = 1.0) {
+            std::lock_guard<std::mutex> lock(mutex);
+            histograms.emplace_back(name, help, scale);
+            return histograms.back();
+        }
+
+        void WritePrometheus(std::ostream& out) const {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (const auto& counter : counters) counter.Write(out);
+            for (const auto& gauge : gauges) gauge.Write(out);
+            for (const auto& histogram : histograms) histogram.Write(out);
+        }
+
+        std::string Prometheus() const {
+            std::ostringstream out;
+            WritePrometheus(out);
+            return out.str();
+        }
+
+        // write to a sibling file and rename over the target so scrapers never see a partial file
+        bool WriteFile(const std::string& path) const {
+            std::string tmpPath = path + ".tmp";
+            {
+                std::ofstream file(tmpPath, std::ios::trunc);
+                if (!file.is_open()) return false;
+                file << Prometheus();
+                if (!file.good()) return false;
+            }
+            return std::rename(tmpPath.c_str(), path.c_str()) == 0;
+        }
+
+    private:
+        mutable std::mutex mutex;
+        std::deque<Counter> counters;
+        std::deque<Gauge> gauges;
+        std::deque<Histogram> histograms;
+    };
+
+    /*
+     * Publishes a registry for local scrapers. endpoint is either a file path, rewritten every
+     * interval (for node_exporter's textfile collector), or "unix:<path>", a stream socket that
+     * answers every request with a minimal HTTP/1.0 response carrying one snapshot.
+     */
+    class Exporter {
+    public:
+        Exporter(const Registry& registry, std::string endpoint, std::chrono::milliseconds interval, bool debug)
+            : registry(registry), endpoint(std::move(endpoint)), interval(interval), debug(debug) {
+            const std::string unixPrefix = "unix:";
+            if (this->endpoint.compare(0, unixPrefix.size(), unixPrefix) == 0) {
+#ifndef _WIN32
+                socketPath = this->endpoint.substr(unixPrefix.size());
+                listenFd = OpenSocket(socketPath);
+                if (listenFd < 0) {
+                    if (debug) std::cerr << "failed to open metrics socket: " << socketPath << "\n";
+                    return;
+                }
+                worker = std::thread([this] { ServeSocket(); });
+#else
+                if (debug) std::cerr << "unix socket metrics endpoints are not supported on this platform\n";
+                return;
+#endif
+            } else {
+                worker = std::thread([this] { ServeFile(); });
+            }
+            if (debug) std::cout << "exporting metrics to " << this->endpoint << "\n";
+        }
+
+        ~Exporter() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                running = false;
+            }
+            wake.notify_all();
+            if (worker.joinable()) worker.join();
+#ifndef _WIN32
+            if (listenFd >= 0) {
+                close(listenFd);
+                unlink(socketPath.c_str());
+            }
+#endif
+        }
+
+        Exporter(const Exporter&) = delete;
+        Exporter& operator=(const Exporter&) = delete;
+
+    private:
+        const Registry& registry;
+        std::string endpoint;
+        std::chrono::milliseconds interval;
+        bool debug;
+
+        std::mutex mutex;
+        std::condition_variable wake;
+        bool running{true};
+        std::thread worker;
+
+        void ServeFile() {
+            std::unique_lock<std::mutex> lock(mutex);
+            do {
+                lock.unlock();
+                if (!registry.WriteFile(endpoint) && debug) std::cerr << "failed to write metrics file: " << endpoint << "\n";
+                lock.lock();
+            } while (!wake.wait_for(lock, interval, [this] { return !running; }));
+            // final snapshot so short runs still leave their numbers behind
+            lock.unlock();
+            registry.WriteFile(endpoint);
+        }
+
+#ifndef _WIN32
+        std::string socketPath;
+        int listenFd{-1};
+
+        static int OpenSocket(const std::string& path) {
+            sockaddr_un address{};
+            if (path.size() >= sizeof(address.sun_path)) return -1;
+            address.sun_family = AF_UNIX;
+            path.copy(address.sun_path, path.size());
+
+            int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd < 0) return -1;
+            unlink(path.c_str());
+            if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(fd, 8) != 0) {
+                close(fd);
+                return -1;
+            }
+            return fd;
+        }
+
+        void ServeSocket() {
+            while (true) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (!running) return;
+                }
+                pollfd pending{listenFd, POLLIN, 0};
+                if (poll(&pending, 1, static_cast<int>(interval.count())) <= 0) continue;
+
+                int client = accept(listenFd, nullptr, nullptr);
+                if (client < 0) continue;
+                if (ReadRequest(client)) {
+                    std::string snapshot = registry.Prometheus();
+                    SendAll(client, "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: "
+                                    + std::to_string(snapshot.size()) + "\r\nConnection: close\r\n\r\n" + snapshot);
+                }
+                close(client);
+            }
+        }
+
+        // waits briefly for the request head; what it asks for doesn't matter, every request gets the snapshot
+        static bool ReadRequest(int client) {
+            std::string request;
+            char buffer[512];
+            while (request.find("\r\n\r\n") == std::string::npos && request.find("\n\n") == std::string::npos) {
+                pollfd pending{client, POLLIN, 0};
+                if (request.size() > 8192 || poll(&pending, 1, 1000) <= 0) return false;
+                ssize_t received = recv(client, buffer, sizeof(buffer), 0);
+                if (received <= 0) return false;
+                request.append(buffer, static_cast<size_t>(received));
+            }
+            return true;
+        }
+
+        static void SendAll(int client, const std::string& response) {
+            const char* data = response.data();
+            size_t remaining = response.size();
+            while (remaining > 0) {
+                ssize_t written = send(client, data, remaining, MSG_NOSIGNAL);
+                if (written <= 0) break;
+                data += written;
+                remaining -= static_cast<size_t>(written);
+            }
+        }
+#endif
+    };
+
+    // the engine-wide metric set; subsystems receive the pieces they update
+    struct EngineMetrics {
+        Histogram* frameTime;
+        Histogram* initStepTime;
+        Histogram* queueSubmitLatency;
+        Counter* uploadBytes;
+        Counter* readbackBytes;
+        Gauge* allocatedDeviceBytes;
+        Counter* pipelinesCreated;
+        Gauge* swapchainImages;
+        Counter* heapAllocations;
+        Counter* frameHeapAllocations;
+        Gauge* frameArenaBytes;
+        Counter* exportedSteps;
+        Counter* exportSkippedSteps;
+        Gauge* exportConsumers;
+    };
+
+    inline EngineMetrics MakeEngineMetrics(Registry& registry) {
+        EngineMetrics engineMetrics{};
+        engineMetrics.frameTime = &registry.MakeHistogram("mmeas_frame_seconds", "CPU time per frame/simulation step.", 1e-9);
+        engineMetrics.initStepTime = &registry.MakeHistogram("mmeas_init_step_seconds", "Time spent in each engine initialisation step.", 1e-9);
+        engineMetrics.queueSubmitLatency = &registry.MakeHistogram("mmeas_queue_submit_seconds", "Latency of vkQueueSubmit calls.", 1e-9);
+        engineMetrics.uploadBytes = &registry.MakeCounter("mmeas_upload_bytes_total", "Bytes uploaded from host to device.");
+        engineMetrics.readbackBytes = &registry.MakeCounter("mmeas_readback_bytes_total", "Bytes read back from device to host.");
+        engineMetrics.allocatedDeviceBytes = &registry.MakeGauge("mmeas_device_allocated_bytes", "Device memory currently allocated by the engine.");
+        engineMetrics.pipelinesCreated = &registry.MakeCounter("mmeas_pipelines_created_total", "Pipelines compiled by the engine.");
+        engineMetrics.swapchainImages = &registry.MakeGauge("mmeas_swapchain_images", "Images in the current swapchain.");
+        engineMetrics.heapAllocations = &registry.MakeCounter("mmeas_heap_allocations_total", "Allocations the engine's memory resources passed to the general-purpose heap.");
+        engineMetrics.frameHeapAllocations = &registry.MakeCounter("mmeas_frame_heap_allocations_total", "Global heap allocations made inside frames, by any code on the render thread.");
+        engineMetrics.frameArenaBytes = &registry.MakeGauge("mmeas_frame_arena_bytes", "Frame arena bytes used by the last frame.");
+        engineMetrics.exportedSteps = &registry.MakeCounter("mmeas_export_steps_total", "Steps published to external consumers.");
+        engineMetrics.exportSkippedSteps = &registry.MakeCounter("mmeas_export_skipped_steps_total", "Steps not exported because a consumer still held the slot.");
+        engineMetrics.exportConsumers = &registry.MakeGauge("mmeas_export_consumers", "Consumer processes connected to the exporter.");
+        return engineMetrics;
+    }
+}
@@ -0,0 +1,226 @@
+#pragma once
+#include "config.h"
+#include "shaders.h"
+
+namespace vkInit {
+    struct ComputePipelineInBundle {
+        vk::Device device;
+        std::string shaderFilepath;
+        uint32_t pushConstantSize;
+        // optional specialization constants, one uint32_t per constant_id starting at 0
+        std::vector<uint32_t> specializationConstants;
+        std::vector<vk::DescriptorSetLayout> setLayouts;
+    };
+
+    struct ComputePipelineOutBundle {
+        vk::PipelineLayout layout;
+        vk::Pipeline pipeline;
+    };
+
+    vk::PipelineLayout MakePipelineLayout(vk::Device device, vk::ShaderStageFlags stages, uint32_t pushConstantSize,
+                                          const std::vector<vk::DescriptorSetLayout>& setLayouts, bool debug){
+        if (debug) std::cout << "creating pipeline layout" << "\n";
+
+        vk::PushConstantRange pushConstantInfo = vk::PushConstantRange(
+                stages,
+                0, pushConstantSize
+        );
+
+        vk::PipelineLayoutCreateInfo layoutInfo = vk::PipelineLayoutCreateInfo(
+                vk::PipelineLayoutCreateFlags(),
+                static_cast<uint32_t>(setLayouts.size()), setLayouts.data(),
+                pushConstantSize > 0 ? 1 : 0, &pushConstantInfo
+        );
+
+        try{
+            return device.createPipelineLayout(layoutInfo);
+        }catch(vk::SystemError err){
+            if (debug) std::cerr << "failed to create pipeline layout: " << err.what() << "\n";
+        }
+        return nullptr;
+    }
+
+    ComputePipelineOutBundle MakeComputePipeline(const ComputePipelineInBundle& specification, bool debug){
+        if (debug) std::cout << "creating compute pipeline for " << specification.shaderFilepath << "\n";
+
+        vk::ShaderModule shaderModule = vkUtil::CreateModule(specification.shaderFilepath, specification.device, debug);
+
+        std::vector<vk::SpecializationMapEntry> mapEntries;
+        for (uint32_t i = 0; i < specification.specializationConstants.size(); i++){
+            mapEntries.emplace_back(i, i * sizeof(uint32_t), sizeof(uint32_t));
+        }
+        vk::SpecializationInfo specializationInfo = vk::SpecializationInfo(
+                static_cast<uint32_t>(mapEntries.size()), mapEntries.data(),
+                specification.specializationConstants.size() * sizeof(uint32_t),
+                specification.specializationConstants.data()
+        );
+
+        vk::PipelineShaderStageCreateInfo stageInfo = vk::PipelineShaderStageCreateInfo(
+                vk::PipelineShaderStageCreateFlags(),
+                vk::ShaderStageFlagBits::eCompute,
+                shaderModule,
+                "main",
+                mapEntries.empty() ? nullptr : &specializationInfo
+        );
+
+        ComputePipelineOutBundle output;
+        output.layout = MakePipelineLayout(specification.device, vk::ShaderStageFlagBits::eCompute,
+                                           specification.pushConstantSize, specification.setLayouts, debug);
+
+        vk::ComputePipelineCreateInfo pipelineInfo = vk::ComputePipelineCreateInfo(
+                vk::PipelineCreateFlags(),
+                stageInfo,
+                output.layout
+        );
+
+        try{
+            output.pipeline = specification.device.createComputePipeline(nullptr, pipelineInfo).value;
+        }catch(vk::SystemError err){
+            specification.device.destroyShaderModule(shaderModule);
+            specification.device.destroyPipelineLayout(output.layout);
+            throw std::runtime_error("failed to create compute pipeline " + specification.shaderFilepath + ": " + err.what());
+        }
+
+        specification.device.destroyShaderModule(shaderModule);
+        return output;
+    }
+
+    /*
+     * Full-screen pass: no vertex input, one colour attachment, push constants visible to both
+     * stages. Used for screen-space effects such as the volume ray march.
+     */
+    struct GraphicsPipelineInBundle {
+        vk::Device device;
+        std::string vertexFilepath;
+        std::string fragmentFilepath;
+        vk::Extent2D swapchainExtent;
+        // owned by the caller; the pipeline draws into its first subpass
+        vk::RenderPass renderpass;
+        uint32_t pushConstantSize;
+        std::vector<vk::DescriptorSetLayout> setLayouts;
+    };
+
+    struct GraphicsPipelineOutBundle {
+        vk::PipelineLayout layout;
+        vk::Pipeline pipeline;
+    };
+
+    vk::RenderPass MakeRenderpass(vk::Device device, vk::Format swapchainImageFormat, bool debug){
+        vk::AttachmentDescription colorAttachment = vk::AttachmentDescription(
+                vk::AttachmentDescriptionFlags(),
+                swapchainImageFormat,
+                vk::SampleCountFlagBits::e1,
+                vk::AttachmentLoadOp::eClear,
+                vk::AttachmentStoreOp::eStore,
+                vk::AttachmentLoadOp::eDontCare,
+                vk::AttachmentStoreOp::eDontCare,
+                vk::ImageLayout::eUndefined,
+                vk::ImageLayout::ePresentSrcKHR
+        );
+
+        vk::AttachmentReference colorAttachmentRef = vk::AttachmentReference(0, vk::ImageLayout::eColorAttachmentOptimal);
+
+        vk::SubpassDescription subpass = vk::SubpassDescription(
+                vk::SubpassDescriptionFlags(),
+                vk::PipelineBindPoint::eGraphics,
+                0, nullptr,
+                1, &colorAttachmentRef
+        );
+
+        vk::RenderPassCreateInfo renderpassInfo = vk::RenderPassCreateInfo(
+                vk::RenderPassCreateFlags(),
+                1, &colorAttachment,
+                1, &subpass
+        );
+
+        try{
+            return device.createRenderPass(renderpassInfo);
+        }catch(vk::SystemError err){
+            if (debug) std::cerr << "failed to create renderpass: " << err.what() << "\n";
+        }
+        return nullptr;
+    }
+
+    GraphicsPipelineOutBundle MakeFullscreenPipeline(const GraphicsPipelineInBundle& specification, bool debug){
+        if (debug) std::cout << "creating full-screen pipeline for " << specification.fragmentFilepath << "\n";
+
+        vk::PipelineVertexInputStateCreateInfo vertexInputInfo = vk::PipelineVertexInputStateCreateInfo();
+        vk::PipelineInputAssemblyStateCreateInfo inputAssemblyInfo = vk::PipelineInputAssemblyStateCreateInfo(
+                vk::PipelineInputAssemblyStateCreateFlags(),
+                vk::PrimitiveTopology::eTriangleList
+        );
+
+        vk::ShaderModule vertexShader = vkUtil::CreateModule(specification.vertexFilepath, specification.device, debug);
+        vk::ShaderModule fragmentShader;
+        try{
+            fragmentShader = vkUtil::CreateModule(specification.fragmentFilepath, specification.device, debug);
+        }catch(...){
+            specification.device.destroyShaderModule(vertexShader);
+            throw;
+        }
+        std::array<vk::PipelineShaderStageCreateInfo, 2> shaderStages = {
+                vk::PipelineShaderStageCreateInfo(vk::PipelineShaderStageCreateFlags(), vk::ShaderStageFlagBits::eVertex, vertexShader, "main"),
+                vk::PipelineShaderStageCreateInfo(vk::PipelineShaderStageCreateFlags(), vk::ShaderStageFlagBits::eFragment, fragmentShader, "main")
+        };
+
+        vk::Viewport viewport = vk::Viewport(
+                0.0f, 0.0f,
+                static_cast<float>(specification.swapchainExtent.width),
+                static_cast<float>(specification.swapchainExtent.height),
+                0.0f, 1.0f
+        );
+        vk::Rect2D scissor = vk::Rect2D(vk::Offset2D(0, 0), specification.swapchainExtent);
+        vk::PipelineViewportStateCreateInfo viewportState = vk::PipelineViewportStateCreateInfo(
+                vk::PipelineViewportStateCreateFlags(),
+                1, &viewport,
+                1, &scissor
+        );
+
+        vk::PipelineRasterizationStateCreateInfo rasterizer = vk::PipelineRasterizationStateCreateInfo();
+        rasterizer.polygonMode = vk::PolygonMode::eFill;
+        rasterizer.cullMode = vk::CullModeFlagBits::eNone;
+        rasterizer.frontFace = vk::FrontFace::eClockwise;
+        rasterizer.lineWidth = 1.0f;
+
+        vk::PipelineMultisampleStateCreateInfo multisampling = vk::PipelineMultisampleStateCreateInfo();
+        multisampling.rasterizationSamples = vk::SampleCountFlagBits::e1;
+
+        vk::PipelineColorBlendAttachmentState colorBlendAttachment = vk::PipelineColorBlendAttachmentState();
+        colorBlendAttachment.colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG
+                | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA;
+        vk::PipelineColorBlendStateCreateInfo colorBlending = vk::PipelineColorBlendStateCreateInfo();
+        colorBlending.attachmentCount = 1;
+        colorBlending.pAttachments = &colorBlendAttachment;
+
+        GraphicsPipelineOutBundle output;
+        output.layout = MakePipelineLayout(specification.device,
+                                           vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment,
+                                           specification.pushConstantSize, specification.setLayouts, debug);
+
+        vk::GraphicsPipelineCreateInfo pipelineInfo = vk::GraphicsPipelineCreateInfo();
+        pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+        pipelineInfo.pStages = shaderStages.data();
+        pipelineInfo.pVertexInputState = &vertexInputInfo;
+        pipelineInfo.pInputAssemblyState = &inputAssemblyInfo;
+        pipelineInfo.pViewportState = &viewportState;
+        pipelineInfo.pRasterizationState = &rasterizer;
+        pipelineInfo.pMultisampleState = &multisampling;
+        pipelineInfo.pColorBlendState = &colorBlending;
+        pipelineInfo.layout = output.layout;
+        pipelineInfo.renderPass = specification.renderpass;
+        pipelineInfo.subpass = 0;
+
+        try{
+            output.pipeline = specification.device.createGraphicsPipeline(nullptr, pipelineInfo).value;
+        }catch(vk::SystemError err){
+            specification.device.destroyShaderModule(vertexShader);
+            specification.device.destroyShaderModule(fragmentShader);
+            specification.device.destroyPipelineLayout(output.layout);
+            throw std::runtime_error("failed to create graphics pipeline: " + std::string(err.what()));
+        }
+
+        specification.device.destroyShaderModule(vertexShader);
+        specification.device.destroyShaderModule(fragmentShader);
+        return output;
+    }
+}
@@ -6,8 +6,8 @@ namespace vkUtil {
     std::vector<char> readFile(std::string filename, bool debug){
         std::ifstream file(filename, std::ios::ate | std::ios::binary);
 
-        if(debug && !file.is_open()){
-            std::cerr << "failed to open file: " << filename << "\n";
+        if (!file.is_open()){
+            throw std::runtime_error("failed to open file: " + filename);
         }
 
         size_t filesize{static_cast<size_t>(file.tellg())};
@@ -19,4 +19,19 @@ namespace vkUtil {
         file.close();
         return buffer;
     }
+
+    vk::ShaderModule CreateModule(std::string filename, vk::Device device, bool debug){
+        std::vector<char> sourceCode = readFile(filename, debug);
+
+        vk::ShaderModuleCreateInfo moduleInfo = {};
+        moduleInfo.flags = vk::ShaderModuleCreateFlags();
+        moduleInfo.codeSize = sourceCode.size();
+        moduleInfo.pCode = reinterpret_cast<const uint32_t*>(sourceCode.data());
+
+        try{
+            return device.createShaderModule(moduleInfo);
+        }catch(vk::SystemError err){
+            throw std::runtime_error("failed to create shader module for \"" + filename + "\": " + err.what());
+        }
+    }
 }
\ No newline at end of file
@@ -0,0 +1,27 @@
+#pragma once
+#include "config.h"
+
+namespace vkInit {
+    vk::Semaphore MakeSemaphore(vk::Device device, bool debug){
+        vk::SemaphoreCreateInfo semaphoreInfo = vk::SemaphoreCreateInfo();
+
+        try{
+            return device.createSemaphore(semaphoreInfo);
+        }catch(vk::SystemError err){
+            if (debug) std::cerr << "failed to create semaphore: " << err.what() << "\n";
+            return nullptr;
+        }
+    }
+
+    // created signalled, so the first wait on a frame that has never been submitted returns at once
+    vk::Fence MakeFence(vk::Device device, bool debug){
+        vk::FenceCreateInfo fenceInfo = vk::FenceCreateInfo(vk::FenceCreateFlagBits::eSignaled);
+
+        try{
+            return device.createFence(fenceInfo);
+        }catch(vk::SystemError err){
+            if (debug) std::cerr << "failed to create fence: " << err.what() << "\n";
+            return nullptr;
+        }
+    }
+}
@@ -0,0 +1,88 @@
+#include "Consumer.h"
+
+#include <cstdlib>
+#include <cstring>
+
+/*
+ * Reads the "frame" buffer the engine exports with --export <name>: every word of a step
+ * carries the same frame count, so a torn or stale read shows up as mixed values.
+ *
+ *     mmeas --export frames &
+ *     mmeas_consumer frames --steps 10
+ */
+int main(int argc, char* argv[]) {
+    if (argc < 2){
+        std::cerr << "usage: mmeas_consumer <export name> [--steps N] [--debugMode]\n";
+        return 2;
+    }
+    std::string name = argv[1];
+    uint64_t stepLimit = 10;
+    bool debugMode = false;
+    for (int i = 2; i < argc; i++){
+        if (strcmp(argv[i], "--debugMode") == 0){
+            debugMode = true;
+        } else if (strcmp(argv[i], "--steps") == 0 && i + 1 < argc){
+            stepLimit = std::strtoull(argv[++i], nullptr, 10);
+        }
+    }
+
+    vk::ApplicationInfo appInfo = vk::ApplicationInfo("mmeas_consumer", 1, "MMEAS", 1, VK_API_VERSION_1_2);
+    vk::Instance instance = vk::createInstance(vk::InstanceCreateInfo(vk::InstanceCreateFlags(), &appInfo));
+
+    vk::PhysicalDevice physicalDevice{nullptr};
+    for (vk::PhysicalDevice candidate : instance.enumeratePhysicalDevices()){
+        if (vkInterop::Consumer::MatchesDevice(name, candidate)) physicalDevice = candidate;
+    }
+    if (!physicalDevice){
+        std::cerr << "no GPU here runs export \"" << name << "\"\n";
+        instance.destroy();
+        return 1;
+    }
+
+    auto supported = physicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>();
+    vk::PhysicalDeviceVulkan12Features features12;
+    features12.timelineSemaphore = VK_TRUE;
+    features12.bufferDeviceAddress = supported.get<vk::PhysicalDeviceVulkan12Features>().bufferDeviceAddress;
+
+    // the frame buffer is only read through its mapping, but a device needs a queue
+    float priority = 1.0f;
+    vk::DeviceQueueCreateInfo queueInfo = vk::DeviceQueueCreateInfo(vk::DeviceQueueCreateFlags(), 0, 1, &priority);
+    std::vector<const char*> extensions = vkInterop::ConsumerDeviceExtensions();
+    vk::DeviceCreateInfo deviceInfo = vk::DeviceCreateInfo(vk::DeviceCreateFlags(), 1, &queueInfo, 0, nullptr,
+                                                           static_cast<uint32_t>(extensions.size()), extensions.data());
+    deviceInfo.pNext = &features12;
+    vk::Device device = physicalDevice.createDevice(deviceInfo);
+    vk::detail::DispatchLoaderDynamic dispatch(instance, vkGetInstanceProcAddr, device);
+
+    int status = 0;
+    try{
+        vkInterop::Consumer consumer(name, physicalDevice, device, dispatch, debugMode);
+        uint32_t resource = consumer.FindResource("frame");
+        size_t words = consumer.Description(resource).size / sizeof(uint32_t);
+        if (!consumer.Description(resource).hostVisible) throw std::runtime_error("the frame buffer is not host visible");
+
+        uint64_t received = 0;
+        while (received < stepLimit){
+            std::optional<vkInterop::ConsumerFrame> frame = consumer.Acquire(std::chrono::seconds(5));
+            if (!frame){
+                std::cerr << (consumer.ProducerAlive() ? "no step within 5 s" : "the producer stopped") << "\n";
+                break;
+            }
+            const uint32_t* values = static_cast<const uint32_t*>(consumer.Mapped(resource, frame->slot));
+            bool uniform = std::all_of(values, values + words, [&](uint32_t value) { return value == values[0]; });
+            std::cout << "step " << frame->step << " slot " << frame->slot << " frame " << values[0]
+                      << (uniform ? "" : " (torn)") << "\n";
+            if (!uniform) status = 1;
+            received++;
+        }
+        consumer.Release();
+        if (received == 0) status = 1;
+    }catch(const std::exception& err){
+        std::cerr << "failed to consume export \"" << name << "\": " << err.what() << "\n";
+        status = 1;
+    }
+
+    device.destroy();
+    instance.destroy();
+    return status;
+}
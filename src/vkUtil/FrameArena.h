@@ -0,0 +1,142 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+
+#include "../metrics.h"
+
+namespace vkUtil {
+    /*
+     * Pass-through resource that counts what reaches the general-purpose heap. The engine routes
+     * its arenas through one of these, so a non-zero count during a frame means something
+     * allocated outside the frame budget.
+     */
+    class CountingResource : public std::pmr::memory_resource {
+    public:
+        explicit CountingResource(metrics::Counter* allocationCounter = nullptr,
+                                  std::pmr::memory_resource* upstream = std::pmr::new_delete_resource())
+            : allocationCounter(allocationCounter), upstream(upstream) {}
+
+        uint64_t Allocations() const { return allocations.load(std::memory_order_relaxed); }
+        uint64_t AllocatedBytes() const { return allocatedBytes.load(std::memory_order_relaxed); }
+
+    private:
+        metrics::Counter* allocationCounter;
+        std::pmr::memory_resource* upstream;
+        std::atomic<uint64_t> allocations{0};
+        std::atomic<uint64_t> allocatedBytes{0};
+
+        void* do_allocate(size_t bytes, size_t alignment) override {
+            allocations.fetch_add(1, std::memory_order_relaxed);
+            allocatedBytes.fetch_add(bytes, std::memory_order_relaxed);
+            if (allocationCounter) allocationCounter->Add();
+            return upstream->allocate(bytes, alignment);
+        }
+
+        void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+            upstream->deallocate(p, bytes, alignment);
+        }
+
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+            return this == &other;
+        }
+    };
+
+    /*
+     * Bump allocator for data that lives at most one frame. Allocation is a pointer bump,
+     * deallocation is a no-op and Reset() at the frame boundary reclaims everything at once.
+     *
+     * Requests that don't fit spill to upstream; the next Reset() grows the block by the spilled
+     * amount, so after a warm-up frame a steady-state frame never touches the heap.
+     * Not thread safe: one arena per thread that builds frame data.
+     */
+    class FrameArena : public std::pmr::memory_resource {
+    public:
+        explicit FrameArena(size_t capacity, std::pmr::memory_resource* upstream = std::pmr::get_default_resource())
+            : upstream(upstream), capacity(capacity) {
+            block = static_cast<std::byte*>(upstream->allocate(capacity, blockAlignment));
+        }
+
+        ~FrameArena() override {
+            ReleaseOverflow();
+            upstream->deallocate(block, capacity, blockAlignment);
+        }
+
+        FrameArena(const FrameArena&) = delete;
+        FrameArena& operator=(const FrameArena&) = delete;
+
+        // invalidates everything allocated since the previous Reset
+        void Reset() {
+            highWater = std::max(highWater, offset + overflowBytes);
+            if (overflowBytes > 0){
+                ReleaseOverflow();
+                upstream->deallocate(block, capacity, blockAlignment);
+                capacity += overflowBytes + overflowBytes / 2;
+                block = static_cast<std::byte*>(upstream->allocate(capacity, blockAlignment));
+            }
+            offset = 0;
+            overflowBytes = 0;
+        }
+
+        size_t Used() const { return offset + overflowBytes; }
+        size_t Capacity() const { return capacity; }
+        size_t HighWater() const { return std::max(highWater, Used()); }
+
+    private:
+        static constexpr size_t blockAlignment = alignof(std::max_align_t);
+
+        // spilled allocations are chained through a header in front of the user block
+        struct OverflowHeader {
+            OverflowHeader* next;
+            size_t bytes;
+            size_t alignment;
+        };
+
+        std::pmr::memory_resource* upstream;
+        std::byte* block;
+        size_t capacity;
+        size_t offset{0};
+        size_t overflowBytes{0};
+        size_t highWater{0};
+        OverflowHeader* overflow{nullptr};
+
+        static size_t AlignUp(size_t value, size_t alignment) {
+            return (value + alignment - 1) & ~(alignment - 1);
+        }
+
+        void* do_allocate(size_t bytes, size_t alignment) override {
+            size_t start = AlignUp(reinterpret_cast<uintptr_t>(block) + offset, alignment) - reinterpret_cast<uintptr_t>(block);
+            if (start + bytes <= capacity){
+                offset = start + bytes;
+                return block + start;
+            }
+
+            size_t headerAlignment = std::max(alignment, alignof(OverflowHeader));
+            size_t headerSize = AlignUp(sizeof(OverflowHeader), headerAlignment);
+            auto* raw = static_cast<std::byte*>(upstream->allocate(headerSize + bytes, headerAlignment));
+            auto* header = reinterpret_cast<OverflowHeader*>(raw + headerSize - sizeof(OverflowHeader));
+            *header = OverflowHeader{overflow, headerSize + bytes, headerAlignment};
+            overflow = header;
+            overflowBytes += bytes + alignment;
+            return raw + headerSize;
+        }
+
+        void do_deallocate(void*, size_t, size_t) override {}
+
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+            return this == &other;
+        }
+
+        void ReleaseOverflow() {
+            while (overflow){
+                OverflowHeader* next = overflow->next;
+                size_t headerSize = AlignUp(sizeof(OverflowHeader), overflow->alignment);
+                std::byte* raw = reinterpret_cast<std::byte*>(overflow) + sizeof(OverflowHeader) - headerSize;
+                upstream->deallocate(raw, overflow->bytes, overflow->alignment);
+                overflow = next;
+            }
+        }
+    };
+}
@@ -0,0 +1,185 @@
+#pragma once
+#include "../config.h"
+
+namespace vkUtil {
+    struct Buffer {
+        vk::Buffer buffer{nullptr};
+        vk::DeviceMemory memory{nullptr};
+        vk::DeviceSize size{0};
+        vk::DeviceAddress address{0};
+        void* mapped{nullptr};
+        // what a process importing the memory has to reproduce
+        vk::DeviceSize allocationSize{0};
+        uint32_t memoryTypeIndex{0};
+        bool dedicated{false};
+    };
+
+    struct BufferInput {
+        vk::DeviceSize size;
+        vk::BufferUsageFlags usage;
+        vk::MemoryPropertyFlags properties;
+        vk::PhysicalDevice physicalDevice;
+        vk::Device device;
+        // non-empty to allocate memory other processes can import
+        vk::ExternalMemoryHandleTypeFlags exportHandleTypes{};
+    };
+
+    uint32_t FindMemoryTypeIndex(vk::PhysicalDevice physicalDevice, uint32_t supportedMemoryIndices, vk::MemoryPropertyFlags requestedProperties){
+        vk::PhysicalDeviceMemoryProperties memoryProperties = physicalDevice.getMemoryProperties();
+
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++){
+            bool supported = static_cast<bool>(supportedMemoryIndices & (1u << i));
+            bool sufficient = (memoryProperties.memoryTypes[i].propertyFlags & requestedProperties) == requestedProperties;
+            if (supported && sufficient) return i;
+        }
+        throw std::runtime_error("failed to find a suitable memory type");
+    }
+
+    /*
+     * Buffers created with eShaderDeviceAddress usage also get their device address filled in,
+     * and host visible buffers stay persistently mapped. Exported buffers get a dedicated
+     * allocation whenever the driver asks for one.
+     */
+    Buffer CreateBuffer(const BufferInput& input){
+        Buffer buffer;
+        buffer.size = input.size;
+        bool exported = static_cast<bool>(input.exportHandleTypes);
+
+        vk::ExternalMemoryBufferCreateInfo externalInfo = vk::ExternalMemoryBufferCreateInfo(input.exportHandleTypes);
+        vk::BufferCreateInfo bufferInfo = vk::BufferCreateInfo(
+                vk::BufferCreateFlags(),
+                input.size,
+                input.usage,
+                vk::SharingMode::eExclusive
+        );
+        if (exported) bufferInfo.pNext = &externalInfo;
+        buffer.buffer = input.device.createBuffer(bufferInfo);
+
+        vk::MemoryRequirements requirements = input.device.getBufferMemoryRequirements(buffer.buffer);
+        if (exported){
+            auto requirements2 = input.device.getBufferMemoryRequirements2<vk::MemoryRequirements2, vk::MemoryDedicatedRequirements>(
+                    vk::BufferMemoryRequirementsInfo2(buffer.buffer));
+            const auto& dedicatedRequirements = requirements2.get<vk::MemoryDedicatedRequirements>();
+            buffer.dedicated = dedicatedRequirements.requiresDedicatedAllocation || dedicatedRequirements.prefersDedicatedAllocation;
+        }
+        bool deviceAddress = static_cast<bool>(input.usage & vk::BufferUsageFlagBits::eShaderDeviceAddress);
+        buffer.allocationSize = requirements.size;
+        buffer.memoryTypeIndex = FindMemoryTypeIndex(input.physicalDevice, requirements.memoryTypeBits, input.properties);
+
+        vk::MemoryDedicatedAllocateInfo dedicatedInfo = vk::MemoryDedicatedAllocateInfo(nullptr, buffer.buffer);
+        vk::ExportMemoryAllocateInfo exportInfo = vk::ExportMemoryAllocateInfo(input.exportHandleTypes);
+        vk::MemoryAllocateFlagsInfo allocateFlags = vk::MemoryAllocateFlagsInfo(vk::MemoryAllocateFlagBits::eDeviceAddress);
+        vk::MemoryAllocateInfo allocateInfo = vk::MemoryAllocateInfo(requirements.size, buffer.memoryTypeIndex);
+
+        const void* next = nullptr;
+        if (buffer.dedicated){
+            dedicatedInfo.pNext = next;
+            next = &dedicatedInfo;
+        }
+        if (exported){
+            exportInfo.pNext = next;
+            next = &exportInfo;
+        }
+        if (deviceAddress){
+            allocateFlags.pNext = next;
+            next = &allocateFlags;
+        }
+        allocateInfo.pNext = next;
+
+        try{
+            buffer.memory = input.device.allocateMemory(allocateInfo);
+        }catch(vk::SystemError err){
+            input.device.destroyBuffer(buffer.buffer);
+            throw std::runtime_error("failed to allocate buffer memory: " + std::string(err.what()));
+        }
+        input.device.bindBufferMemory(buffer.buffer, buffer.memory, 0);
+
+        if (deviceAddress) buffer.address = input.device.getBufferAddress(vk::BufferDeviceAddressInfo(buffer.buffer));
+        if (input.properties & vk::MemoryPropertyFlagBits::eHostVisible) {
+            buffer.mapped = input.device.mapMemory(buffer.memory, 0, input.size);
+        }
+        return buffer;
+    }
+
+    void DestroyBuffer(vk::Device device, Buffer& buffer){
+        if (buffer.mapped) device.unmapMemory(buffer.memory);
+        device.destroyBuffer(buffer.buffer);
+        device.freeMemory(buffer.memory);
+        buffer = Buffer{};
+    }
+
+    struct Image {
+        vk::Image image{nullptr};
+        vk::DeviceMemory memory{nullptr};
+        vk::ImageView view{nullptr};
+        vk::DeviceSize size{0};
+        uint32_t memoryTypeIndex{0};
+        bool dedicated{false};
+    };
+
+    struct ImageInput {
+        vk::ImageType type;
+        vk::Extent3D extent;
+        vk::Format format;
+        vk::ImageUsageFlags usage;
+        vk::PhysicalDevice physicalDevice;
+        vk::Device device;
+        vk::ExternalMemoryHandleTypeFlags exportHandleTypes{};
+    };
+
+    // single mip, single layer, device local, colour aspect
+    Image CreateImage(const ImageInput& input){
+        Image image;
+        bool exported = static_cast<bool>(input.exportHandleTypes);
+
+        vk::ExternalMemoryImageCreateInfo externalInfo = vk::ExternalMemoryImageCreateInfo(input.exportHandleTypes);
+        vk::ImageCreateInfo imageInfo = vk::ImageCreateInfo(
+                vk::ImageCreateFlags(),
+                input.type, input.format, input.extent,
+                1, 1, vk::SampleCountFlagBits::e1,
+                vk::ImageTiling::eOptimal, input.usage,
+                vk::SharingMode::eExclusive
+        );
+        if (exported) imageInfo.pNext = &externalInfo;
+        image.image = input.device.createImage(imageInfo);
+
+        vk::MemoryRequirements requirements = input.device.getImageMemoryRequirements(image.image);
+        if (exported){
+            auto requirements2 = input.device.getImageMemoryRequirements2<vk::MemoryRequirements2, vk::MemoryDedicatedRequirements>(
+                    vk::ImageMemoryRequirementsInfo2(image.image));
+            const auto& dedicatedRequirements = requirements2.get<vk::MemoryDedicatedRequirements>();
+            image.dedicated = dedicatedRequirements.requiresDedicatedAllocation || dedicatedRequirements.prefersDedicatedAllocation;
+        }
+        image.memoryTypeIndex = FindMemoryTypeIndex(input.physicalDevice, requirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal);
+
+        vk::MemoryDedicatedAllocateInfo dedicatedInfo = vk::MemoryDedicatedAllocateInfo(image.image, nullptr);
+        vk::ExportMemoryAllocateInfo exportInfo = vk::ExportMemoryAllocateInfo(input.exportHandleTypes);
+        vk::MemoryAllocateInfo allocateInfo = vk::MemoryAllocateInfo(requirements.size, image.memoryTypeIndex);
+        if (image.dedicated) exportInfo.pNext = &dedicatedInfo;
+        if (exported) allocateInfo.pNext = &exportInfo;
+        try{
+            image.memory = input.device.allocateMemory(allocateInfo);
+        }catch(vk::SystemError err){
+            input.device.destroyImage(image.image);
+            throw std::runtime_error("failed to allocate image memory: " + std::string(err.what()));
+        }
+        input.device.bindImageMemory(image.image, image.memory, 0);
+        image.size = requirements.size;
+
+        vk::ImageViewCreateInfo viewInfo = {};
+        viewInfo.image = image.image;
+        viewInfo.viewType = input.type == vk::ImageType::e3D ? vk::ImageViewType::e3D : vk::ImageViewType::e2D;
+        viewInfo.format = input.format;
+        viewInfo.subresourceRange = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
+        image.view = input.device.createImageView(viewInfo);
+
+        return image;
+    }
+
+    void DestroyImage(vk::Device device, Image& image){
+        device.destroyImageView(image.view);
+        device.destroyImage(image.image);
+        device.freeMemory(image.memory);
+        image = Image{};
+    }
+}
@@ -11,10 +11,13 @@ namespace vkUtil {
         bool IsComplete() const { return graphicsFamily.has_value() && presentFamily.has_value(); }
     };
 
-    QueueFamilyIndices FindQueueFamilies(vk::PhysicalDevice device, vk::SurfaceKHR surface, bool debug) {
+    // memory backs the temporary property list; pass the frame arena when called per frame
+    QueueFamilyIndices FindQueueFamilies(vk::PhysicalDevice device, vk::SurfaceKHR surface, bool debug,
+                                         std::pmr::memory_resource* memory = std::pmr::get_default_resource()) {
         QueueFamilyIndices indices;
 
-        std::vector<vk::QueueFamilyProperties> queueFamilies = device.getQueueFamilyProperties();
+        std::pmr::polymorphic_allocator<vk::QueueFamilyProperties> allocator(memory);
+        std::pmr::vector<vk::QueueFamilyProperties> queueFamilies = device.getQueueFamilyProperties(allocator);
 
         if (debug) std::cout << "system can support " << queueFamilies.size() << " queue families.\n";
 
@@ -5,5 +5,13 @@ namespace vkUtil {
     struct SwapChainFrame {
         vk::Image image;
         vk::ImageView imageView;
+        vk::Framebuffer framebuffer{nullptr};
+
+        // used by the frame in flight with this index, independent of the image it acquires
+        vk::CommandBuffer commandBuffer{nullptr};
+        vk::Fence inFlight{nullptr};
+        vk::Semaphore imageAvailable{nullptr};
+        // signalled for the present of this image
+        vk::Semaphore renderFinished{nullptr};
     };
-}
\ No newline at end of file
+}
@@ -6,9 +6,11 @@
 
 namespace vkInit {
     struct SwapChainSupportDetails{
+        explicit SwapChainSupportDetails(std::pmr::memory_resource* memory) : formats(memory), presentModes(memory) {}
+
         vk::SurfaceCapabilitiesKHR capabilities;
-        std::vector<vk::SurfaceFormatKHR> formats;
-        std::vector<vk::PresentModeKHR> presentModes;
+        std::pmr::vector<vk::SurfaceFormatKHR> formats;
+        std::pmr::vector<vk::PresentModeKHR> presentModes;
 
         bool IsComplete() {return !formats.empty() && !presentModes.empty();}
     };
@@ -20,8 +22,10 @@ namespace vkInit {
         vk::Extent2D extent;
     };
 
-    SwapChainSupportDetails QuerySwapchainSupport(vk::PhysicalDevice device, vk::SurfaceKHR surface, bool debug){
-        SwapChainSupportDetails support;
+    // the format and present mode lists are allocated from memory, typically the frame arena
+    SwapChainSupportDetails QuerySwapchainSupport(vk::PhysicalDevice device, vk::SurfaceKHR surface, bool debug,
+                                                  std::pmr::memory_resource* memory = std::pmr::get_default_resource()){
+        SwapChainSupportDetails support(memory);
         support.capabilities = device.getSurfaceCapabilitiesKHR(surface);
         if (debug){
             std::cout << "swapchain can support the following surface capabilities:\n";
@@ -62,7 +66,8 @@ namespace vkInit {
 
         }
 //
-        support.formats = device.getSurfaceFormatsKHR(surface);
+        std::pmr::polymorphic_allocator<vk::SurfaceFormatKHR> formatAllocator(memory);
+        support.formats = device.getSurfaceFormatsKHR(surface, formatAllocator);
         if(debug){
             for (const auto& supported : support.formats) {
                 std::cout << "\tsupported pixel format: " << vk::to_string(supported.format) << "\n";
@@ -70,7 +75,8 @@ namespace vkInit {
             }
         }
 
-        support.presentModes = device.getSurfacePresentModesKHR(surface);
+        std::pmr::polymorphic_allocator<vk::PresentModeKHR> presentModeAllocator(memory);
+        support.presentModes = device.getSurfacePresentModesKHR(surface, presentModeAllocator);
         if(debug){
             for (const auto& presentMode : support.presentModes) {
                 std::cout << "\tsupported present mode: " << LogPresentMode(presentMode) << "\n";
@@ -80,7 +86,7 @@ namespace vkInit {
         return support;
     }
 
-    vk::SurfaceFormatKHR ChooseSwapchainSurfaceFormat(std::vector<vk::SurfaceFormatKHR> formats){
+    vk::SurfaceFormatKHR ChooseSwapchainSurfaceFormat(const std::pmr::vector<vk::SurfaceFormatKHR>& formats){
         for(const auto& format : formats){
             if(format.format == vk::Format::eB8G8R8A8Srgb && format.colorSpace == vk::ColorSpaceKHR::eSrgbNonlinear){
                 return format;
@@ -89,7 +95,7 @@ namespace vkInit {
         return formats[0];
     }
 
-    vk::PresentModeKHR ChooseSwapchainPresentMode(std::vector<vk::PresentModeKHR> presentModes){
+    vk::PresentModeKHR ChooseSwapchainPresentMode(const std::pmr::vector<vk::PresentModeKHR>& presentModes){
         for (const auto& presentMode : presentModes){
             if (presentMode == vk::PresentModeKHR::eMailbox){
                 return presentMode;
@@ -98,7 +104,7 @@ namespace vkInit {
         return vk::PresentModeKHR::eFifo;
     }
 
-    vk::Extent2D ChooseSwapchainExtent(uint32_t width, uint32_t height, vk::SurfaceCapabilitiesKHR capabilities){
+    vk::Extent2D ChooseSwapchainExtent(uint32_t width, uint32_t height, const vk::SurfaceCapabilitiesKHR& capabilities){
         if(capabilities.currentExtent.width != UINT32_MAX){
             return capabilities.currentExtent;
         }else{
@@ -115,8 +121,10 @@ namespace vkInit {
         }
     }
 
-    SwapChainBundle CreateSwapchain(vk::Device logicalDevice, vk::PhysicalDevice physicalDevice, vk::SurfaceKHR surface, int width, int height, bool debug){
-        SwapChainSupportDetails support = QuerySwapchainSupport(physicalDevice, surface, debug);
+    // memory only backs temporaries; the returned bundle owns ordinary long-lived storage
+    SwapChainBundle CreateSwapchain(vk::Device logicalDevice, vk::PhysicalDevice physicalDevice, vk::SurfaceKHR surface, int width, int height, bool debug,
+                                    std::pmr::memory_resource* memory = std::pmr::get_default_resource()){
+        SwapChainSupportDetails support = QuerySwapchainSupport(physicalDevice, surface, debug, memory);
         vk::SurfaceFormatKHR format = ChooseSwapchainSurfaceFormat(support.formats);
         vk::PresentModeKHR presentMode = ChooseSwapchainPresentMode(support.presentModes);
         vk::Extent2D extent = ChooseSwapchainExtent(width, height, support.capabilities);
@@ -129,7 +137,7 @@ namespace vkInit {
                 surface, imageCount, format.format, format.colorSpace,
                 extent, 1 , vk::ImageUsageFlagBits::eColorAttachment
         );
-        vkUtil::QueueFamilyIndices indices = vkUtil::FindQueueFamilies(physicalDevice, surface, debug);
+        vkUtil::QueueFamilyIndices indices = vkUtil::FindQueueFamilies(physicalDevice, surface, debug, memory);
         uint32_t queueFamilyIndices[] = {indices.graphicsFamily.value(), indices.presentFamily.value()};
 
         if (indices.graphicsFamily.value() != indices.presentFamily.value()){
@@ -154,7 +162,8 @@ namespace vkInit {
             throw std::runtime_error("failed to create swapchain: " + std::string(err.what()));
         }
 
-        std::vector<vk::Image> images = logicalDevice.getSwapchainImagesKHR(bundle.swapchain);
+        std::pmr::polymorphic_allocator<vk::Image> imageAllocator(memory);
+        std::pmr::vector<vk::Image> images = logicalDevice.getSwapchainImagesKHR(bundle.swapchain, imageAllocator);
         bundle.frames.resize(images.size());
 
         for (size_t i = 0; i<images.size();i++){
@@ -0,0 +1,193 @@
+#include "../src/metrics.h"
+#include "../src/vkUtil/FrameArena.h"
+#include "../src/compute/Reference.h"
+
+#include <random>
+#include <set>
+
+/*
+ * Checks for the parts of the engine that run without a GPU: metric buckets and exposition,
+ * the frame memory resources, half conversion and the CPU spatial grid. Each check prints
+ * what failed; the exit status is the number of failures.
+ */
+namespace {
+    int failures = 0;
+
+    void Check(bool condition, const std::string& what) {
+        if (condition) return;
+        std::cerr << "FAILED: " << what << "\n";
+        failures++;
+    }
+
+    void HistogramBuckets() {
+        using metrics::Histogram;
+        for (uint32_t i = 0; i + 1 < Histogram::bucketCount; i++){
+            uint64_t bound = Histogram::BucketUpperBound(i);
+            Check(Histogram::BucketIndex(bound) == i, "upper bound of bucket " + std::to_string(i) + " lands in it");
+            Check(Histogram::BucketIndex(bound + 1) == i + 1, "value past bucket " + std::to_string(i) + " lands in the next one");
+        }
+        Check(Histogram::BucketIndex(std::numeric_limits<uint64_t>::max()) == Histogram::bucketCount - 1, "largest sample lands in the last bucket");
+
+        // relative error of the reported bound stays within one sub-bucket
+        std::mt19937_64 random(7);
+        for (int i = 0; i < 10000; i++){
+            uint64_t v = random() >> (random() % 64);
+            uint64_t bound = Histogram::BucketUpperBound(Histogram::BucketIndex(v));
+            Check(bound >= v && static_cast<double>(bound - v) <= static_cast<double>(v) / Histogram::subBucketCount,
+                  "bucket bound of " + std::to_string(v) + " is within the relative error");
+        }
+    }
+
+    void PrometheusFormat() {
+        metrics::Registry registry;
+        registry.MakeCounter("test_total", "A counter.").Add(3);
+        metrics::Gauge& gauge = registry.MakeGauge("test_gauge", "A gauge.");
+        gauge.Set(5);
+        gauge.Add(-7);
+        metrics::Histogram& histogram = registry.MakeHistogram("test_seconds", "A histogram.", 1e-9);
+        for (uint64_t v : {1ull, 1000ull, 1001ull, 123456789ull}) histogram.Record(v);
+        Check(histogram.Count() == 4, "histogram count sums the buckets");
+
+        std::string text = registry.Prometheus();
+        Check(text.find("# HELP test_total A counter.\n# TYPE test_total counter\ntest_total 3\n") != std::string::npos, "counter exposition");
+        Check(text.find("# TYPE test_gauge gauge\ntest_gauge -2\n") != std::string::npos, "gauge exposition");
+        Check(text.find("# TYPE test_seconds histogram\n") != std::string::npos, "histogram type line");
+        Check(text.find("test_seconds_bucket{le=\"+Inf\"} 4\n") != std::string::npos, "+Inf bucket holds every sample");
+        Check(text.find("test_seconds_count 4\n") != std::string::npos, "_count matches +Inf");
+        Check(text.find("test_seconds_sum 0.123458791") != std::string::npos, "_sum is scaled and printed in full");
+
+        // le labels are unique, increasing, and their counts cumulative
+        std::istringstream lines(text);
+        std::string line;
+        std::set<std::string> labels;
+        double lastBound = -1.0;
+        uint64_t lastCount = 0;
+        while (std::getline(lines, line)){
+            const std::string prefix = "test_seconds_bucket{le=\"";
+            if (line.compare(0, prefix.size(), prefix) != 0 || line.find("+Inf") != std::string::npos) continue;
+            size_t end = line.find('"', prefix.size());
+            std::string label = line.substr(prefix.size(), end - prefix.size());
+            uint64_t count = std::stoull(line.substr(line.find("} ") + 2));
+            Check(labels.insert(label).second, "le label " + label + " appears once");
+            Check(std::stod(label) > lastBound && count >= lastCount, "bucket " + label + " is ordered and cumulative");
+            lastBound = std::stod(label);
+            lastCount = count;
+        }
+        Check(labels.size() == 3, "one bucket line per populated bucket");
+    }
+
+    void CountingResource() {
+        metrics::Registry registry;
+        metrics::Counter& counter = registry.MakeCounter("allocations_total", "Allocations.");
+        vkUtil::CountingResource resource(&counter);
+        void* a = resource.allocate(100, 16);
+        void* b = resource.allocate(28, 8);
+        Check(resource.Allocations() == 2 && resource.AllocatedBytes() == 128, "counting resource counts calls and bytes");
+        Check(counter.Value() == 2, "counting resource feeds its counter");
+        Check(reinterpret_cast<uintptr_t>(a) % 16 == 0, "counting resource keeps the alignment");
+        resource.deallocate(a, 100, 16);
+        resource.deallocate(b, 28, 8);
+        Check(resource.Allocations() == 2, "deallocation is not counted");
+    }
+
+    void FrameArena() {
+        vkUtil::CountingResource heap;
+        vkUtil::FrameArena arena(256, &heap);
+        Check(heap.Allocations() == 1, "arena allocates its block up front");
+
+        void* first = arena.allocate(100, 8);
+        void* aligned = arena.allocate(10, 64);
+        Check(reinterpret_cast<uintptr_t>(aligned) % 64 == 0, "arena honours alignment");
+        Check(static_cast<std::byte*>(aligned) > static_cast<std::byte*>(first), "arena bumps forward");
+        Check(heap.Allocations() == 1, "requests inside the block stay off the heap");
+
+        (void)arena.allocate(400, 8);
+        Check(heap.Allocations() == 2, "a request past the block spills to upstream");
+        Check(arena.Used() >= 500, "spilled bytes count as used");
+
+        // the next frame starts with a block large enough for the previous one
+        arena.Reset();
+        uint64_t afterGrow = heap.Allocations();
+        Check(arena.Capacity() > 500, "reset grows the block by the spill");
+        Check(arena.Used() == 0 && arena.HighWater() >= 500, "reset clears usage and keeps the high water mark");
+        (void)arena.allocate(100, 8);
+        (void)arena.allocate(10, 64);
+        (void)arena.allocate(400, 8);
+        Check(heap.Allocations() == afterGrow, "the same frame after the warm-up never reaches the heap");
+
+        arena.Reset();
+        Check(heap.Allocations() == afterGrow, "reset without a spill keeps the block");
+
+        std::pmr::vector<int> values(&arena);
+        values.assign(32, 1);
+        Check(heap.Allocations() == afterGrow, "pmr containers allocate from the arena");
+    }
+
+    void HalfConversion() {
+        using vkCompute::FloatToHalf;
+        Check(FloatToHalf(0.0f) == 0x0000 && FloatToHalf(-0.0f) == 0x8000, "signed zeros");
+        Check(FloatToHalf(1.0f) == 0x3C00 && FloatToHalf(-2.0f) == 0xC000, "exact normals");
+        Check(FloatToHalf(0.1f) == 0x2E66, "0.1 rounds to nearest");
+        Check(FloatToHalf(65504.0f) == 0x7BFF, "largest finite half");
+        Check(FloatToHalf(65520.0f) == 0x7C00, "values rounding past the largest half become infinity");
+        Check(FloatToHalf(std::numeric_limits<float>::infinity()) == 0x7C00, "infinity");
+        Check((FloatToHalf(std::numeric_limits<float>::quiet_NaN()) & 0x7E00) == 0x7E00, "NaN stays NaN");
+        Check(FloatToHalf(std::ldexp(1.0f, -24)) == 0x0001, "smallest subnormal");
+        Check(FloatToHalf(std::ldexp(1.0f, -25)) == 0x0000, "half the smallest subnormal ties to even zero");
+        Check(FloatToHalf(1.0f + std::ldexp(1.0f, -11)) == 0x3C00, "ties round to even, down");
+        Check(FloatToHalf(1.0f + 3.0f * std::ldexp(1.0f, -11)) == 0x3C02, "ties round to even, up");
+    }
+
+    void SpatialGrid() {
+        std::mt19937 random(1234);
+        std::uniform_real_distribution<float> coordinate(-4.0f, 12.0f);
+        std::vector<vkCompute::Particle> positions(2000);
+        for (vkCompute::Particle& position : positions) position = {coordinate(random), coordinate(random), coordinate(random), 1.0f};
+
+        const float radius = 1.0f;
+        std::vector<uint32_t> expected(positions.size());
+        for (size_t i = 0; i < positions.size(); i++){
+            for (size_t j = 0; j < positions.size(); j++){
+                float dx = positions[j][0] - positions[i][0], dy = positions[j][1] - positions[i][1], dz = positions[j][2] - positions[i][2];
+                if (i != j && dx * dx + dy * dy + dz * dz <= radius * radius) expected[i]++;
+            }
+        }
+
+        // a uniform grid covering the points exactly and a hashed one over the unbounded domain
+        vkCompute::GridParams uniform{{-4.0f, -4.0f, -4.0f}, 1.0f / radius, {16, 16, 16}, 16 * 16 * 16};
+        vkCompute::GridParams hashed{{0.0f, 0.0f, 0.0f}, 1.0f / radius, {0, 0, 0}, 4093};
+        for (const vkCompute::GridParams& params : {uniform, hashed}){
+            std::string kind = params.dims[0] ? "uniform" : "hashed";
+            vkCompute::SpatialGridCpu grid(params);
+            grid.Build(positions);
+
+            uint32_t running = 0;
+            bool prefix = true;
+            for (uint32_t c = 0; c < params.tableSize; c++){
+                prefix = prefix && grid.cellStart[c] == running;
+                running += grid.cellCount[c];
+            }
+            Check(prefix && running == positions.size(), kind + " grid cell starts are the prefix sum of the counts");
+
+            std::vector<uint32_t> order = grid.sortedToOriginal;
+            std::sort(order.begin(), order.end());
+            bool permutation = true;
+            for (uint32_t i = 0; i < order.size(); i++) permutation = permutation && order[i] == i;
+            Check(permutation, kind + " grid sorted order is a permutation");
+
+            Check(grid.CountNeighbors(radius) == expected, kind + " grid neighbour counts match brute force");
+        }
+    }
+}
+
+int main() {
+    HistogramBuckets();
+    PrometheusFormat();
+    CountingResource();
+    FrameArena();
+    HalfConversion();
+    SpatialGrid();
+
+    if (failures == 0) std::cout << "all CPU checks passed\n";
+    return failures;
+}